@@ -0,0 +1,40 @@
+#ifndef ALIGNED_H
+#define ALIGNED_H
+
+#include <cstddef>
+#include <new>
+#include <xmmintrin.h>
+
+/*
+Allocates memory aligned to a cache line, for use with std::vector.
+Rows of cells then start on a cache line, and may be loaded with aligned vector instructions.
+*/
+template <class T> class AlignedAllocator {
+public:
+	typedef T value_type;
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+	template <class U> struct rebind { typedef AlignedAllocator<U> other; };
+	static const std::size_t alignment = 64;
+
+	AlignedAllocator() {}
+	template <class U> AlignedAllocator(const AlignedAllocator<U> &) {}
+
+	T *allocate(std::size_t n) {
+		void *p = _mm_malloc(n * sizeof(T), alignment);
+		if (!p) throw std::bad_alloc();
+		return (T *)p;
+	}
+	void deallocate(T *p, std::size_t) { _mm_free(p); }
+	std::size_t max_size() const { return ((std::size_t)-1) / sizeof(T); }
+	void construct(T *p, const T &value) { new ((void *)p) T(value); }
+	void destroy(T *p) { p->~T(); }
+	bool operator==(const AlignedAllocator &) const { return true; }
+	bool operator!=(const AlignedAllocator &) const { return false; }
+};
+
+#endif
\ No newline at end of file
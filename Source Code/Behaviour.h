@@ -7,13 +7,16 @@
 #include <Math.h>
 #define PI 3.14159265
 #include "Vertex.h"
-#include "Record.h"
+#include "RecordStore.h"
+#include "Random.h"
 #include "Grid.h"
+#include "Retention.h"
+#include "Smoother.h"
 using namespace std;
 
 class Behaviour {
 public:
-	Behaviour(Robot *r, double startGran, double minGran, double split, int strategy);
+	Behaviour(Robot *r, double startGran, double minGran, double split, int strategy, GridOptions gridOptions);
 	Robot *r;
 	void nextMove(float n);
 	void nextLidar(float n);
@@ -26,11 +29,14 @@ public:
 	set<Vertex> overlay(Vertex v, float a);
 	float collision(int move, float amount);
 	void runStrategy(float elapsed);
+	float wallDistance(Vertex fr);
+	float fieldDistance(Vertex fr);
 	enum move {FORWARD, BACKWARD, LEFT, RIGHT};
 	bool toleranceFilter(Record r);
 	void restore();
+	bool smooth(unsigned int limit, bool map);
 	//
-	vector<Record> data;
+	RecordStore data;
 	float angle, lidarAngle;
 	Vertex location;
 	float xV, yV;
@@ -46,7 +52,22 @@ public:
 	set<Vertex> intersectCells;
 	int strategy;
 	double startGran, minGran, split;
+	GridOptions gridOptions;
+	//The first record mapped since the grid began logging, when reverting.
+	unsigned int epochStart;
+	//Decimates the records settled by each kalman update, when retention is on.
+	Retention retention;
+	//Smooths back from the last beacon, over as many lidar readings as the smooth budget needs.
+	Smoother smoother;
 	float turned;
+	Random random;
+	//Strategy 1 variables.
+	bool turning;
+	int lastMove;
+	//Strategy 2, 3 and 4 variables.
+	int direction;
+	float remaining;
+	bool lastBack, toggle;
 	//Strategy 3 variables (for displaying)
 	static const int quadW = 8, quadH = 8;
 	int quadrant[quadW][quadH];
@@ -54,7 +75,7 @@ public:
 	int curX, curY;
 };
 
-Behaviour::Behaviour(Robot *r, double startGran, double minGran, double split, int strategy) {
+Behaviour::Behaviour(Robot *r, double startGran, double minGran, double split, int strategy, GridOptions gridOptions = GridOptions()) {
 	this->r = r;
 	this->angle = 0;
 	this->lidarAngle = 0;
@@ -64,8 +85,8 @@ Behaviour::Behaviour(Robot *r, double startGran, double minGran, double split, i
 	tolerance = 99999;
 	r->updateLidar();
 	data.push_back(Record(location.x, location.y, angle, lidarAngle, r->lidarDistance, xV, yV));
-	grid = Grid(startGran, minGran, split, &data);
-	srand((unsigned)time(NULL));
+	grid = Grid(startGran, minGran, split, &data, gridOptions);
+	random = r->random.split();
 	lookAhead = sqrt(r->width * r->width + r->height * r->height) -
 		(r->width > r->height ? r->width : r->height);
 	previousLocation.x = -1; previousLocation.y = -1;
@@ -78,7 +99,14 @@ Behaviour::Behaviour(Robot *r, double startGran, double minGran, double split, i
 	this->startGran = startGran;
 	this->minGran = minGran;
 	this->split = split;
+	this->gridOptions = gridOptions;
+	if (gridOptions.retention) retention = Retention(gridOptions.recordBudget, gridOptions.retentionTolerance);
+	epochStart = data.size();
+	if (gridOptions.revert) grid.begin();
 	turned = 0;
+	turning = false; lastMove = 1;
+	direction = -1; remaining = 0;
+	lastBack = false; toggle = false;
 }
 
 //Resets behaviour to its original state for a new test.
@@ -92,7 +120,11 @@ void Behaviour::restore() {
 	r->updateLidar();
 	data.clear();
 	data.push_back(Record(location.x, location.y, angle, lidarAngle, r->lidarDistance, xV, yV));
-	grid = Grid(startGran, minGran, split, &data);
+	grid = Grid(startGran, minGran, split, &data, gridOptions);
+	if (gridOptions.retention) retention = Retention(gridOptions.recordBudget, gridOptions.retentionTolerance);
+	smoother = Smoother();
+	epochStart = data.size();
+	if (gridOptions.revert) grid.begin();
 	lookAhead = sqrt(r->width * r->width + r->height * r->height) -
 		(r->width > r->height ? r->width : r->height);
 	previousLocation.x = -1; previousLocation.y = -1;
@@ -102,6 +134,9 @@ void Behaviour::restore() {
 		for (int x = 0; x < quadW; x++)
 			quadrant[x][y] = 0;
 	turned = 0;
+	turning = false; lastMove = 1;
+	direction = -1; remaining = 0;
+	lastBack = false; toggle = false;
 }
 
 void Behaviour::runStrategy(float elapsed) {
@@ -116,89 +151,17 @@ void Behaviour::runStrategy(float elapsed) {
 			fr.x = x2 * cos(radians) + y2 * sin(radians) + location.x;
 			fr.y = x2 * sin(radians) - y2 * cos(radians) + location.y;
 
-			//Calculate the equation of the line.
-			float a = angle - 45;
-			if (a < 0) a += 360;
-			float m = tan(a * (float)PI / 180);
-			float c = fr.y - m * fr.x;
-
-			//Determine which way to step in x and y.
-			int stepX = 0, stepY = 0;
-			if (a > 0 && a < 180) stepY = 1;
-			else if (a < 360) stepY = -1;
-			if (a > 0 && a < 90 || a > 270 && a < 360) stepX = 1;
-			else if (a > 90 && a < 270) stepX = -1;
-
-			//Step in x, calculate the corresponding y, add to set.
-			intersectCells.clear();
-			bool cond = true;
-			for (int x = grid.cellX(fr.x); stepX != 0 && cond; x += stepX) {
-				int y = grid.cellY(m * grid.worldX(x) + c);
-				intersectCells.insert(Vertex((float)x, (float)y));
-				if (y == 0 || y == grid.height) break;
-				cond = (stepX == 1) ? x <= grid.width : x >= 0;
-			}
-
-			//Step in y, calculate corresponding x, add to set.
-			cond = true;
-			for (int y = grid.cellY(fr.y); stepY != 0 && cond; y += stepY) {
-				int x = grid.cellX((grid.worldY(y) - c) / m);
-				intersectCells.insert(Vertex((float)x, (float)y));
-				if (x == 0 || x == grid.width) break;
-				cond = (stepY == 1) ? y <= grid.height : y >= 0;
-			}
-
-			//Verify cells lie in the correct quadrant.
-			//This is needed due to errors when tan(n) -> +- infinity
-			int startX = grid.cellX(fr.x);
-			int startY = grid.cellY(fr.y);
-			set<Vertex> errors;
-			for (set<Vertex>::iterator i = intersectCells.begin(); i != intersectCells.end(); i++)
-				if ((i->x - startX) * stepX < 0 || (i->y - startY) * stepY < 0)
-					errors.insert(*i);
-			set<Vertex> difference;
-			set_difference(intersectCells.begin(), intersectCells.end(),
-						   errors.begin(), errors.end(),
-						   inserter(difference, difference.end()));
-			intersectCells = difference;
-
-
-			//Find the distance to nearest cell with p > 0, or to the cell at the edge of grid.
-			float d = 999999;
-			for (set<Vertex>::iterator i = intersectCells.begin(); i != intersectCells.end(); i++) {
-				if (i->x < 1 || i->x >= grid.width - 1 || i->y < 1 || i->y >= grid.height - 1 ||
-				grid.cells[(int)i->x][(int)i->y] > 0) {
-					float x = (float)grid.worldX((int)i->x) + 0.5f * (float)grid.curGran;
-					float y = (float)grid.worldY((int)i->y) + 0.5f * (float)grid.curGran;
-					float distance = sqrt((fr.x - x) * (fr.x - x) + (fr.y - y) * (fr.y - y));
-					if (distance < d) d = distance;
-				}
-			}
-
-			//Remove all other cells from the set (display only).
-			set<Vertex> tooFar;
-			for (set<Vertex>::iterator i = intersectCells.begin(); i != intersectCells.end(); i++) {
-				float x = (float)grid.worldX((int)i->x) + 0.5f * (float)grid.curGran;
-				float y = (float)grid.worldY((int)i->y) + 0.5f * (float)grid.curGran;
-				float distance = sqrt((fr.x - x) * (fr.x - x) + (fr.y - y) * (fr.y - y));
-				if (distance > d) tooFar.insert(Vertex(i->x, i->y));
-			}
-			difference.clear();
-			set_difference(intersectCells.begin(), intersectCells.end(),
-						   tooFar.begin(), tooFar.end(),
-						   inserter(difference, difference.end()));
-			intersectCells = difference;
+			//Find the distance to the wall, from the distance field if the grid keeps one.
+			float d = gridOptions.distanceField ? fieldDistance(fr) : wallDistance(fr);
 
 			//Try to maintain distance between 1 and 2 robot width's from the wall.
 			float min = sqrt(2 * ((r->width * 1) * (r->width * 1)));
 			float max = sqrt(2 * ((r->width * 2) * (r->width * 2)));
 
 			//Cycle between forward and turning.
-			static bool turn = false;
-			turn = !turn;
+			turning = !turning;
 
 			//Prevent left-right cycles. (forward: 0, left: 1, right: 2)
-			static int lastMove = 1;
 
 			//Turn away, if too close to the wall.
 			if (d < min) {
@@ -207,7 +170,7 @@ void Behaviour::runStrategy(float elapsed) {
 					lastMove = 0;
 				}
 				else
-					if (turn) {
+					if (turning) {
 						left(r->turnRate * elapsed);
 						lastMove = 1;
 					}
@@ -229,7 +192,7 @@ void Behaviour::runStrategy(float elapsed) {
 					lastMove = 0;
 				}
 				else
-					if (turn) {
+					if (turning) {
 						right(r->turnRate * elapsed);
 						lastMove = 2;
 					}
@@ -254,10 +217,7 @@ void Behaviour::runStrategy(float elapsed) {
 		}
 		//Collision turning strategy.
 		case 2: {
-			static int direction = -1;
-			static float remaining;
 			float directionFactor = 2;
-			static bool lastBack = false;
 
 			//Try to move forward.
 			if (collision(FORWARD, lookAhead) == 0 && !lastBack) {
@@ -272,7 +232,7 @@ void Behaviour::runStrategy(float elapsed) {
 				//Set remaining to the longest out of width and height * a directionFactor.
 				remaining = (r->width > r->height ? r->width : r->height) * directionFactor;
 				//If remaining expired, choose a new direction.
-				if (direction == -1) direction = rand() % 2;
+				if (direction == -1) direction = random.below(2);
 				//Otherwise move in the same direction as previously.
 				if (direction) right(r->turnRate * elapsed);
 				else left(r->turnRate * elapsed);
@@ -414,10 +374,7 @@ void Behaviour::runStrategy(float elapsed) {
 				turn = false;
 
 			//Uses strat 1's collision prevention, but with fixed ideas about direction.
-			static int direction = -1;
-			static float remaining;
 			float directionFactor = 2;
-			static bool lastBack = false;
 
 			//Try to move forward.
 			if (collision(FORWARD, lookAhead) == 0 && !lastBack) {
@@ -438,7 +395,7 @@ void Behaviour::runStrategy(float elapsed) {
 				//Set remaining to the longest out of width and height * a directionFactor.
 				remaining = (r->width > r->height ? r->width : r->height) * directionFactor;
 				//If remaining expired, choose a new direction.
-				if (direction == -1) direction = rand() % 2;
+				if (direction == -1) direction = random.below(2);
 				//Otherwise move in the same direction as previously.
 				if (direction) right(r->turnRate * elapsed);
 				else left(r->turnRate * elapsed);
@@ -554,11 +511,7 @@ void Behaviour::runStrategy(float elapsed) {
 				turn = false;
 
 			//Uses strat 1's collision prevention, but with fixed ideas about direction.
-			static int direction = -1;
-			static float remaining;
 			float directionFactor = 2;
-			static bool lastBack = false;
-			static bool toggle = false;
 			toggle = !toggle;
 
 			//Try to move forward.
@@ -582,7 +535,7 @@ void Behaviour::runStrategy(float elapsed) {
 				//Set remaining to the longest out of width and height * a directionFactor.
 				remaining = (r->width > r->height ? r->width : r->height) * directionFactor;
 				//If remaining expired, choose a new direction.
-				if (direction == -1) direction = rand() % 2;
+				if (direction == -1) direction = random.below(2);
 				//Otherwise move in the same direction as previously.
 				if (direction) right(r->turnRate * elapsed);
 				else left(r->turnRate * elapsed);
@@ -607,6 +560,97 @@ void Behaviour::runStrategy(float elapsed) {
 
 }
 
+/*
+Finds the distance from the front right of the robot to the nearest wall, at 45 degrees to its right.
+Steps along the ray through the grid, keeping the cells it crosses up to the wall (display only).
+*/
+float Behaviour::wallDistance(Vertex fr) {
+	//Calculate the equation of the line.
+	float a = angle - 45;
+	if (a < 0) a += 360;
+	float m = tan(a * (float)PI / 180);
+	float c = fr.y - m * fr.x;
+
+	//Determine which way to step in x and y.
+	int stepX = 0, stepY = 0;
+	if (a > 0 && a < 180) stepY = 1;
+	else if (a < 360) stepY = -1;
+	if (a > 0 && a < 90 || a > 270 && a < 360) stepX = 1;
+	else if (a > 90 && a < 270) stepX = -1;
+
+	//Step in x, calculate the corresponding y, add to set.
+	intersectCells.clear();
+	bool cond = true;
+	for (int x = grid.cellX(fr.x); stepX != 0 && cond; x += stepX) {
+		int y = grid.cellY(m * grid.worldX(x) + c);
+		intersectCells.insert(Vertex((float)x, (float)y));
+		if (y == 0 || y == grid.height) break;
+		cond = (stepX == 1) ? x <= grid.width : x >= 0;
+	}
+
+	//Step in y, calculate corresponding x, add to set.
+	cond = true;
+	for (int y = grid.cellY(fr.y); stepY != 0 && cond; y += stepY) {
+		int x = grid.cellX((grid.worldY(y) - c) / m);
+		intersectCells.insert(Vertex((float)x, (float)y));
+		if (x == 0 || x == grid.width) break;
+		cond = (stepY == 1) ? y <= grid.height : y >= 0;
+	}
+
+	//Verify cells lie in the correct quadrant.
+	//This is needed due to errors when tan(n) -> +- infinity
+	int startX = grid.cellX(fr.x);
+	int startY = grid.cellY(fr.y);
+	set<Vertex> errors;
+	for (set<Vertex>::iterator i = intersectCells.begin(); i != intersectCells.end(); i++)
+		if ((i->x - startX) * stepX < 0 || (i->y - startY) * stepY < 0)
+			errors.insert(*i);
+	set<Vertex> difference;
+	set_difference(intersectCells.begin(), intersectCells.end(),
+				   errors.begin(), errors.end(),
+				   inserter(difference, difference.end()));
+	intersectCells = difference;
+
+
+	//Find the distance to nearest cell with p > 0, or to the cell at the edge of grid.
+	float d = 999999;
+	for (set<Vertex>::iterator i = intersectCells.begin(); i != intersectCells.end(); i++) {
+		if (i->x < 1 || i->x >= grid.width - 1 || i->y < 1 || i->y >= grid.height - 1 ||
+		grid.at((int)i->x, (int)i->y) > 0) {
+			float x = (float)grid.worldX((int)i->x) + 0.5f * (float)grid.curGran;
+			float y = (float)grid.worldY((int)i->y) + 0.5f * (float)grid.curGran;
+			float distance = sqrt((fr.x - x) * (fr.x - x) + (fr.y - y) * (fr.y - y));
+			if (distance < d) d = distance;
+		}
+	}
+
+	//Remove all other cells from the set (display only).
+	set<Vertex> tooFar;
+	for (set<Vertex>::iterator i = intersectCells.begin(); i != intersectCells.end(); i++) {
+		float x = (float)grid.worldX((int)i->x) + 0.5f * (float)grid.curGran;
+		float y = (float)grid.worldY((int)i->y) + 0.5f * (float)grid.curGran;
+		float distance = sqrt((fr.x - x) * (fr.x - x) + (fr.y - y) * (fr.y - y));
+		if (distance > d) tooFar.insert(Vertex(i->x, i->y));
+	}
+	difference.clear();
+	set_difference(intersectCells.begin(), intersectCells.end(),
+				   tooFar.begin(), tooFar.end(),
+				   inserter(difference, difference.end()));
+	intersectCells = difference;
+
+	return d;
+}
+
+//Finds the distance from the front right of the robot to the nearest wall in any direction, from the distance field.
+//The edges of the grid are walls, as they are for the ray.
+float Behaviour::fieldDistance(Vertex fr) {
+	intersectCells.clear();
+	double d = grid.clearance(fr.x, fr.y);
+	d = min(d, min(fr.x - grid.xFrom, grid.xTo - fr.x));
+	d = min(d, min(fr.y - grid.yFrom, grid.yTo - fr.y));
+	return (float)d;
+}
+
 //Must move: moveRate * elapsed, or turn: turnRate * elapsed.
 void Behaviour::nextMove(float elapsed) {
 	//Collect some LIDAR data before starting.
@@ -648,63 +692,80 @@ void Behaviour::nextLidar(float elapsed) {
 	}
 
 	//Add the record and update the grid.
+	//The points mapped here are batched, so that the grid is split at most once.
 	data.push_back(Record(location.x, location.y, angle, lidarAngle, r->lidarDistance, xV, yV));
+	if (gridOptions.batchSplit) grid.beginBatch();
 
-	//Calculates the obstacle vertex and maps it onto grid.
-	Vertex v = getVertex(location.x, location.y, lidarAngle, r->lidarDistance);
+	//Maps the obstacle vertex, found as the record was added, onto grid.
+	Vertex v = data.endpoint(data.size() - 1);
 	grid.mapPoint(v.x, v.y, xV, yV);
 
 	//Update the minimum and maximum variances.
 	if (xV + yV < minVar) minVar = xV + yV;
 	if (xV + yV > maxVar) maxVar = xV + yV;
 
+	//Carry on smoothing back from the previous beacon, finishing first if this reading is a beacon.
+	bool settled = smooth(r->lidarBeacon() ? 0 : gridOptions.smoothBudget, true);
+
 	if (r->lidarBeacon()) {
 		//Kalman filter update.
-		//Iterate backwards over the data until a record with 0 variance.
-		vector<Record> reverse;
-		reverse.push_back(data.back());
-		//grid.revert();
-		for (int i = data.size() - 2; !(data[i].xV == 0 || data[i].yV == 0); i--) {
-			//Find the distance travelled.
-			float dx = data[i].x - data[i + 1].x;
-			float dy = data[i].y - data[i + 1].y;
-			float distance = sqrt(dx * dx + dy * dy);
-
-			//Find the reverse expected location.
-			float radians = data[i - 1].b * (float)PI / 180;
-			float x = reverse.back().x - distance * cos(radians);
-			float y = reverse.back().y - distance * sin(radians);
-
-			//Find the reverse variances.
-			float rxV = reverse.back().xV + abs(dx) * r->mNoise;
-			float ryV = reverse.back().yV + abs(dy) * r->mNoise;
-
-			//Add the record (-1 are unused).
-			reverse.push_back(Record(x, y, -1, -1, -1, rxV, ryV));
+		//Roll the grid back to the previous kalman, so the records since are only mapped where corrected.
+		bool reverted = gridOptions.revert && grid.rollback();
+
+		//Smooth back over the data until a record with 0 variance.
+		//Reverting maps every record since the previous kalman once more, so the pass is finished at once.
+		smoother.start(data);
+		smooth(gridOptions.revert ? 0 : gridOptions.smoothBudget, !reverted);
+		settled = !smoother.active;
+
+		if (gridOptions.revert) {
+			//Map every record since the previous kalman once more, or remap them all if the cells could not be rolled back.
+			if (reverted)
+				for (unsigned int i = epochStart; i < data.size(); i++) {
+					Vertex v = data.endpoint(i);
+					grid.mapPoint(v.x, v.y, data.xV(i), data.yV(i), true);
+				}
+			else grid.remap();
 		}
+	}
+
+	//The records before the beacon of a finished pass are settled, as the next kalman update stops there.
+	if (settled && retention.enabled) retention.decimate(data, smoother.from, grid);
+	if (gridOptions.batchSplit) grid.endBatch();
 
-		//Calculate best estimate locations based on variance weightings.
-		for (unsigned int r = 1, d = data.size() - 2; r < reverse.size(); r++, d--) {
-			//Mean location.
-			float x = data[d].x + (data[d].xV / (data[d].xV + reverse[r].xV)) * (reverse[r].x - data[d].x);
-			float y = data[d].y + (data[d].yV / (data[d].yV + reverse[r].yV)) * (reverse[r].y - data[d].y);
-
-			//Improved variance.
-			float xVar = data[d].xV * reverse[r].xV / (data[d].xV + reverse[r].xV);
-			float yVar = data[d].yV * reverse[r].yV / (data[d].yV + reverse[r].yV);
-
-			//Update the data records.
-			data[d].x = x;
-			data[d].y = y;
-			data[d].xV = xVar;
-			data[d].yV = yVar;
-
-			//Map the improved points to grid.
-			Vertex v = getVertex(data[d].x, data[d].y, data[d].l, data[d].d);
-			grid.mapPoint(v.x, v.y, data[d].xV, data[d].yV, true);
+	//Log the cells changed until the next kalman.
+	if (gridOptions.revert && r->lidarBeacon()) {
+		epochStart = data.size();
+		grid.begin();
+	}
+}
+
+/*
+Fuses the next records of the smoother's pass, up to limit, or all of them if limit is 0.
+The records fused are mapped onto the grid as one batch, after their poses are all set, so the grid splits at most once.
+Returns true if the pass was finished.
+*/
+bool Behaviour::smooth(unsigned int limit, bool map) {
+	if (!smoother.active) return false;
+
+	//Index the records by the tiles they were mapped onto, before any is moved.
+	if (map && grid.tileRecords.enabled) grid.indexRecords();
+	bool done = smoother.step(data, r->mNoise, limit);
+	if (map) {
+		bool batched = grid.batching;
+		if (!batched) grid.beginBatch();
+		for (unsigned int j = 0; j < smoother.fused.size(); j++) {
+			unsigned int i = smoother.fused[j];
+			Vertex v = data.endpoint(i);
+			grid.mapPoint(v.x, v.y, data.xV(i), data.yV(i), true);
 		}
-		reverse.clear();
+
+		//Rebuild the tiles the records moved out of, so that their old hits leave the grid.
+		if (grid.tileRecords.enabled) grid.repair(smoother.fused);
+		if (!batched) grid.endBatch();
 	}
+	smoother.fused.clear();
+	return done;
 }
 
 //Move the robot forward, then update the expected location.
@@ -862,6 +923,17 @@ float Behaviour::collision(int move, float amount) {
 			break;
 	}
 
+	//Skip finding the overlap when no cell with any probability is near enough to be overlapped.
+	float reach = sqrt(r->width * r->width + r->height * r->height) / 2 + 2 * (float)grid.curGran;
+	if (gridOptions.distanceField && gridOptions.fieldThreshold == 0 && grid.clearance(x, y) > reach) {
+		difference.clear();
+		return 0;
+	}
+	if (gridOptions.pyramid && grid.regionMax(grid.cellX(x - reach) - 1, grid.cellY(y - reach) - 1, grid.cellX(x + reach), grid.cellY(y + reach)) == 0) {
+		difference.clear();
+		return 0;
+	}
+
 	//Find the additional vertices the robot would overlap by set-difference.
 	set<Vertex> futureOverlap = overlay(Vertex(x, y), a);
 	difference.clear();
@@ -871,9 +943,20 @@ float Behaviour::collision(int move, float amount) {
 
 	//Sum the probability of collision over the area.
 	float p = 0;
+	if (gridOptions.summedArea) {
+		//The cells are ordered by column, so each run down a column is summed from the tables at once.
+		long long units = 0;
+		for (set<Vertex>::iterator i = difference.begin(), j; i != difference.end(); i = j) {
+			float last = i->y;
+			for (j = i, j++; j != difference.end() && j->x == i->x && j->y == last + 1; j++) last = j->y;
+			units += grid.areaUnits((int)i->x, (int)i->y, (int)i->x, (int)last);
+		}
+		p = (float)SummedArea::probability(units);
+		return (p >= 1) ? 1 : p;
+	}
 	for (set<Vertex>::iterator i = difference.begin(); i != difference.end(); i++) {
 		if (i->x >= 0 && i->x < grid.width && i->y >= 0 && i->y < grid.height) {
-			p += (float)grid.cells[(int)i->x][(int)i->y];
+			p += (float)grid.at((int)i->x, (int)i->y);
 			if (p >= 1) return 1;
 		}
 	}
@@ -0,0 +1,712 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "Grid.h"
+#include "Retention.h"
+#include "Smoother.h"
+#include "Random.h"
+#include <chrono>
+#include <iostream>
+using namespace std;
+
+//Returns the seconds elapsed since start.
+double benchmarkSeconds(chrono::steady_clock::time_point start) {
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/*
+Times the cell lookups made each tick, over grids of increasing width.
+Each tick is taken as the lookups for an overlay, a strategy 1 tracker and a strategy 3 quadrant.
+*/
+void benchmarkCells() {
+	cout << "Cell lookups per tick" << endl;
+	cout << "width\tns/tick" << endl;
+
+	const int ticks = 100000, lookups = 40;
+	RecordStore data;
+	Random random(1);
+	for (int width = 10; width <= 100000; width *= 10) {
+		Grid grid(1, 1, 1, &data);
+		grid.xFrom = -width / 2; grid.xTo = width / 2;
+		grid.yFrom = -width / 2; grid.yTo = width / 2;
+		grid.width = width + 1; grid.height = width + 1;
+
+		//Look up coords spread across the whole grid.
+		//The sum is volatile so that the lookups are not optimised away.
+		volatile long sum = 0;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int tick = 0; tick < ticks; tick++)
+			for (int i = 0; i < lookups; i++) {
+				double offset = (random.uniform() - 0.5) * width;
+				sum += grid.cellX(offset) + grid.cellY(offset);
+			}
+		double seconds = benchmarkSeconds(start);
+		cout << width << "\t" << seconds / ticks * 1000000000 << endl;
+	}
+}
+
+/*
+Times mapping a run of records, as a remap does, exactly and from stamps.
+The records sweep the lidar around a robot whose variance grows, as between beacon sightings.
+*/
+void benchmarkRemap() {
+	cout << "Mapping of 10000 records" << endl;
+	cout << "stampError\tms" << endl;
+
+	RecordStore data;
+	Random random(1);
+	float xV = 0, yV = 0;
+	for (int i = 0; i < 10000; i++) {
+		if (i % 1000 == 0) { xV = 0; yV = 0; }
+		xV += 0.0005f; yV += 0.0005f;
+		data.push_back(Record(0, 0, 0, (float)(i % 360), (float)(2 + 8 * random.uniform()), xV, yV));
+	}
+
+	const double errors[] = {0, 0.01, 0.001, 0.0001};
+	for (int e = 0; e < 4; e++) {
+		GridOptions options;
+		options.stampError = errors[e];
+		//Grow the grid to cover every record first, so only the mapping is timed.
+		Grid grid(0.5, 0.5, 1, &data, options);
+		grid.remap();
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (unsigned int i = 0; i < data.size(); i++) {
+			Vertex v = data.endpoint(i);
+			grid.mapPoint(v.x, v.y, data.xV(i), data.yV(i), true);
+		}
+		double seconds = benchmarkSeconds(start);
+		cout << errors[e] << "\t" << seconds * 1000 << endl;
+	}
+}
+
+/*
+Times rebuilding the grid from a run of records across increasing numbers of threads, splitting down to the minimum.
+Checks that every number of threads gives the same cells as a single thread.
+*/
+void benchmarkRebuild() {
+	cout << "Rebuild of 40000 records" << endl;
+	cout << "threads\tms\tspeedup\tidentical" << endl;
+
+	RecordStore data;
+	Random random(1);
+	float xV = 0, yV = 0;
+	for (int i = 0; i < 40000; i++) {
+		if (i % 1000 == 0) { xV = 0; yV = 0; }
+		xV += 0.0005f; yV += 0.0005f;
+		data.push_back(Record((float)(10 * random.uniform()), (float)(10 * random.uniform()), 0,
+			(float)(i % 360), (float)(2 + 8 * random.uniform()), xV, yV));
+	}
+
+	Grid serial;
+	double serialSeconds = 0;
+	int maxThreads = max(8, (int)thread::hardware_concurrency());
+	for (int threads = 1; threads <= maxThreads; threads *= 2) {
+		GridOptions options;
+		options.threads = threads;
+		Grid grid(1, 0.25, 0.2, &data, options);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		grid.remap();
+		double seconds = benchmarkSeconds(start);
+		if (threads == 1) {
+			serial = grid;
+			serialSeconds = seconds;
+		}
+
+		bool identical = grid.width == serial.width && grid.height == serial.height;
+		for (int y = 0; y < grid.height && identical; y++)
+			for (int x = 0; x < grid.width; x++)
+				if (grid.at(x, y) != serial.at(x, y)) identical = false;
+		cout << threads << "\t" << seconds * 1000 << "\t" << serialSeconds / seconds << "\t" << (identical ? "yes" : "no") << endl;
+	}
+}
+
+/*
+Times mapping records as they are read, splitting as soon as a point splits the grid, then once per batch of points.
+Each batch stands for a beacon sighting, with the records since the last one mapped again once corrected.
+*/
+void benchmarkSplits() {
+	cout << "Mapping of 4000 records in batches of 40" << endl;
+	cout << "batched\tms\tgranularity\trebuilds saved" << endl;
+
+	for (int batched = 0; batched < 2; batched++) {
+		RecordStore data;
+		Random random(1);
+		Grid grid(1, 0.02, 0.2, &data);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int i = 0; i < 100; i++) {
+			if (batched) grid.beginBatch();
+			for (int j = 0; j < 40; j++) {
+				float v = 0.001f * (j + 1);
+				data.push_back(Record((float)(10 * random.uniform()), (float)(10 * random.uniform()), 0,
+					(float)(j * 9), (float)(2 + 8 * random.uniform()), v, v));
+				Vertex p = data.endpoint(data.size() - 1);
+				grid.mapPoint(p.x, p.y, v, v, false);
+			}
+			for (int j = 0; j < 40; j++) {
+				unsigned int r = data.size() - 1 - j;
+				data.setPose(r, data.x(r), data.y(r), data.xV(r) / 2, data.yV(r) / 2);
+				Vertex p = data.endpoint(r);
+				grid.mapPoint(p.x, p.y, data.xV(r), data.yV(r), true);
+			}
+			if (batched) grid.endBatch();
+		}
+		double seconds = benchmarkSeconds(start);
+		cout << (batched ? "yes" : "no") << "\t" << seconds * 1000 << "\t" << grid.curGran << "\t" << grid.rebuildsSaved << endl;
+	}
+}
+
+/*
+Times rebuilding the grid from records along a long diagonal corridor, densely, sparsely then mapped from a file.
+The dense grid covers the whole square the corridor spans, the others only the tiles along it.
+The mapped grid keeps 64 tiles in memory, so the cells stored are mostly in the file.
+*/
+void benchmarkSparse() {
+	cout << "Rebuild of 8000 records along a 200m corridor" << endl;
+	cout << "backend\tms\tcells stored\tcells in memory" << endl;
+
+	RecordStore data;
+	Random random(1);
+	for (int i = 0; i < 8000; i++) {
+		float along = (float)(200 * random.uniform());
+		data.push_back(Record(along, along, 0, (float)(i % 360), (float)(1 + random.uniform()), 0.0005f, 0.0005f));
+	}
+
+	const char *backends[] = {"dense", "sparse", "mapped"};
+	for (int backend = 0; backend < 3; backend++) {
+		GridOptions options;
+		options.sparse = backend == 1;
+		options.mapped = backend == 2;
+		options.residentTiles = 64;
+		Grid grid(0.1, 0.1, 1, &data, options);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		grid.remap();
+		double seconds = benchmarkSeconds(start);
+		size_t stored = grid.cells.size(), resident = grid.cells.size();
+		if (backend > 0) stored = resident = grid.tiles.tiles.size() * Tiles::tileCells * Tiles::tileCells;
+		if (backend == 2) resident = grid.tiles.file->resident.size() * Tiles::tileCells * Tiles::tileCells;
+		cout << backends[backend] << "\t" << seconds * 1000 << "\t" << stored << "\t" << resident << endl;
+	}
+}
+
+/*
+Times rebuilding the grid with cells of each size, fusing by the maximum, then 16 bit cells adding log-odds.
+Compares the quantized cells with the 64 bit cells, which are exact.
+*/
+void benchmarkCellBits() {
+	cout << "Rebuild of 40000 records" << endl;
+	cout << "cellBits\tfusion\tms\tbytes\tworst error" << endl;
+
+	RecordStore data;
+	Random random(1);
+	float xV = 0, yV = 0;
+	for (int i = 0; i < 40000; i++) {
+		if (i % 1000 == 0) { xV = 0; yV = 0; }
+		xV += 0.0005f; yV += 0.0005f;
+		data.push_back(Record((float)(10 * random.uniform()), (float)(10 * random.uniform()), 0,
+			(float)(i % 360), (float)(2 + 8 * random.uniform()), xV, yV));
+	}
+
+	Grid exact;
+	const int bits[] = {64, 16, 8, 16};
+	for (int b = 0; b < 4; b++) {
+		GridOptions options;
+		options.cellBits = bits[b];
+		options.fusion = (b == 3) ? FUSE_LOG_ODDS : FUSE_MAX;
+		Grid grid(0.1, 0.1, 1, &data, options);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		grid.remap();
+		double seconds = benchmarkSeconds(start);
+		if (b == 0) exact = grid;
+
+		//The error is relative to the exact probability, where it is above the smallest code.
+		double worst = 0;
+		for (int y = 0; y < grid.height && b < 3; y++)
+			for (int x = 0; x < grid.width; x++) {
+				double p = exact.at(x, y);
+				if (p > 0.00001) worst = max(worst, fabs(grid.at(x, y) - p) / p);
+			}
+		size_t bytes = (b == 0) ? grid.cells.size() * sizeof(double) : grid.codes.size();
+		cout << bits[b] << "\t" << (b == 3 ? "logOdds" : "max") << "\t" << seconds * 1000 << "\t" << bytes << "\t" << worst << endl;
+	}
+}
+
+/*
+Records of the walls of a 20m room, seen in random directions from a robot at y = 10 crossing it back and forth between x = 2 and 18.
+The robot takes sweep records to cross the room, and each record has the given variance.
+*/
+vector<Record> roomRecords(int n, int sweep, float variance) {
+	vector<Record> records;
+	Random random(1);
+	for (int i = 0; i < n; i++) {
+		float x = (float)(2 + 16 * (1 - fabs(fmod(i / (double)sweep, 2) - 1))), y = 10;
+		float l = (float)(360 * random.uniform());
+		double c = cos(l * PI / 180), s = sin(l * PI / 180);
+		double tx = (c > 0) ? (20 - x) / c : (c < 0) ? -x / c : 1e9;
+		double ty = (s > 0) ? (20 - y) / s : (s < 0) ? -y / s : 1e9;
+		records.push_back(Record(x, y, 0, l, (float)min(tx, ty), variance, variance));
+	}
+	return records;
+}
+
+/*
+Times finding the clearance around the robot after each tick of mapping, from the distance field and by scanning the cells in range.
+The records are of the walls of a 20m room, seen from a robot crossing it, with 10 mapped each tick.
+*/
+void benchmarkClearance() {
+	cout << "Clearance after each tick of 20000 records" << endl;
+	cout << "method\tms\tworst error" << endl;
+
+	vector<Record> data = roomRecords(20000, 20000, 0.0005f);
+
+	vector<double> found[2];
+	for (int method = 0; method < 2; method++) {
+		GridOptions options;
+		options.distanceField = method == 0;
+		RecordStore mapped;
+		Grid grid(0.1, 0.1, 1, &mapped, options);
+		double range = options.fieldRange;
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (unsigned int i = 0; i < data.size(); i++) {
+			mapped.push_back(data[i]);
+			Vertex v = grid.getVertex(data[i].x, data[i].y, data[i].l, data[i].d);
+			grid.mapPoint(v.x, v.y, data[i].xV, data[i].yV);
+			if (i % 10 != 9) continue;
+
+			//Scanning visits every cell within range of the robot's cell.
+			if (method == 0) found[0].push_back(grid.clearance(data[i].x, data[i].y));
+			else {
+				int xC = grid.cellX(data[i].x), yC = grid.cellY(data[i].y);
+				int r = (int)ceil(range / grid.curGran);
+				double d = range;
+				for (int y = max(0, yC - r); y <= min(grid.height - 1, yC + r); y++)
+					for (int x = max(0, xC - r); x <= min(grid.width - 1, xC + r); x++)
+						if (grid.at(x, y) > 0) d = min(d, sqrt((double)(x - xC) * (x - xC) + (y - yC) * (y - yC)) * grid.curGran);
+				found[1].push_back(d);
+			}
+		}
+		double seconds = benchmarkSeconds(start);
+		double worst = 0;
+		for (unsigned int i = 0; i < found[method].size() && method == 1; i++)
+			worst = max(worst, fabs(found[0][i] - found[1][i]));
+		cout << (method == 0 ? "field" : "scan") << "\t" << seconds * 1000 << "\t" << worst << endl;
+	}
+}
+
+/*
+Times summing the cells under 16 candidate footprints after each tick of mapping, cell by cell and from summed-area tables.
+The records are of the walls of a 20m room, as for the clearance, and each footprint is a 1m by 2m box within 2m of the robot.
+*/
+void benchmarkAreas() {
+	cout << "Footprint sums after each tick of 20000 records" << endl;
+	cout << "method\tms\tsums differing" << endl;
+
+	vector<Record> data = roomRecords(20000, 20000, 0.0005f);
+
+	vector<long long> found[2];
+	for (int method = 0; method < 2; method++) {
+		GridOptions options;
+		options.summedArea = method == 1;
+		RecordStore mapped;
+		Grid grid(0.1, 0.1, 1, &mapped, options);
+		Random offsets(2);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (unsigned int i = 0; i < data.size(); i++) {
+			mapped.push_back(data[i]);
+			Vertex v = grid.getVertex(data[i].x, data[i].y, data[i].l, data[i].d);
+			grid.mapPoint(v.x, v.y, data[i].xV, data[i].yV);
+			if (i % 10 != 9) continue;
+
+			for (int k = 0; k < 16; k++) {
+				int xMin = grid.cellX(data[i].x + 4 * (offsets.uniform() - 0.5)), yMin = grid.cellY(data[i].y + 4 * (offsets.uniform() - 0.5));
+				int xMax = xMin + (int)(1 / grid.curGran), yMax = yMin + (int)(2 / grid.curGran);
+				if (method == 1) {
+					found[1].push_back(grid.areaUnits(xMin, yMin, xMax, yMax));
+					continue;
+				}
+				long long units = 0;
+				for (int y = max(yMin, 0); y <= min(yMax, grid.height - 1); y++)
+					for (int x = max(xMin, 0); x <= min(xMax, grid.width - 1); x++)
+						units += SummedArea::units(grid.at(x, y));
+				found[0].push_back(units);
+			}
+		}
+		double seconds = benchmarkSeconds(start);
+		int differing = 0;
+		for (unsigned int i = 0; i < found[method].size() && method == 1; i++)
+			if (found[0][i] != found[1][i]) differing++;
+		cout << (method == 0 ? "cells" : "tables") << "\t" << seconds * 1000 << "\t" << differing << endl;
+	}
+}
+
+/*
+Times finding the largest probability under 16 candidate footprints after each tick of mapping, cell by cell and from the pyramid.
+The records and footprints are those summed by benchmarkAreas.
+The pyramid may count cells just beyond a footprint, so it finds fewer footprints empty, but never one which is not.
+*/
+void benchmarkPyramid() {
+	cout << "Footprint maxima after each tick of 20000 records" << endl;
+	cout << "method\tms\tfound empty\twrongly empty" << endl;
+
+	vector<Record> data = roomRecords(20000, 20000, 0.0005f);
+
+	vector<double> found[2];
+	for (int method = 0; method < 2; method++) {
+		GridOptions options;
+		options.pyramid = method == 1;
+		RecordStore mapped;
+		Grid grid(0.1, 0.1, 1, &mapped, options);
+		Random offsets(2);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (unsigned int i = 0; i < data.size(); i++) {
+			mapped.push_back(data[i]);
+			Vertex v = grid.getVertex(data[i].x, data[i].y, data[i].l, data[i].d);
+			grid.mapPoint(v.x, v.y, data[i].xV, data[i].yV);
+			if (i % 10 != 9) continue;
+
+			for (int k = 0; k < 16; k++) {
+				int xMin = grid.cellX(data[i].x + 4 * (offsets.uniform() - 0.5)), yMin = grid.cellY(data[i].y + 4 * (offsets.uniform() - 0.5));
+				int xMax = xMin + (int)(1 / grid.curGran), yMax = yMin + (int)(2 / grid.curGran);
+				if (method == 1) {
+					found[1].push_back(grid.regionMax(xMin, yMin, xMax, yMax));
+					continue;
+				}
+				double m = 0;
+				for (int y = max(yMin, 0); y <= min(yMax, grid.height - 1); y++)
+					for (int x = max(xMin, 0); x <= min(xMax, grid.width - 1); x++)
+						m = max(m, grid.at(x, y));
+				found[0].push_back(m);
+			}
+		}
+		double seconds = benchmarkSeconds(start);
+		int empty = 0, wrong = 0;
+		for (unsigned int i = 0; i < found[method].size(); i++) {
+			if (found[method][i] == 0) empty++;
+			if (method == 1 && found[1][i] < found[0][i]) wrong++;
+		}
+		cout << (method == 0 ? "cells" : "pyramid") << "\t" << seconds * 1000 << "\t" << empty << "\t" << wrong << endl;
+	}
+}
+
+/*
+Times replaying 40000 records onto a grid, finding each hit from its record, then streaming the hits kept by a record store.
+The last 1000 records have their poses corrected before each replay, as by a kalman update, so only their hits are found again.
+Checks that both give the same cells.
+*/
+void benchmarkRecords() {
+	cout << "Replay of 40000 records" << endl;
+	cout << "records\tms\tidentical" << endl;
+
+	vector<Record> records;
+	RecordStore store;
+	Random random(1);
+	for (int i = 0; i < 40000; i++) {
+		records.push_back(Record((float)(10 * random.uniform()), (float)(10 * random.uniform()), 0,
+			(float)(i % 360), (float)(2 + 8 * random.uniform()), 0.0005f, 0.0005f));
+		store.push_back(records.back());
+	}
+
+	vector<Record> original = records;
+	Grid first;
+	for (int method = 0; method < 2; method++) {
+		records = original;
+		for (unsigned int i = 0; i < records.size(); i++)
+			store.setPose(i, records[i].x, records[i].y, records[i].xV, records[i].yV);
+
+		//Grow the grid to cover every record first, so only the replays are timed.
+		Grid grid(0.1, 0.1, 1, &store);
+		grid.remap();
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int replay = 0; replay < 10; replay++) {
+			for (unsigned int i = records.size() - 1000; i < records.size(); i++) {
+				records[i].x = original[i].x + 0.001f * (replay + 1);
+				store.setPose(i, records[i].x, records[i].y, records[i].xV, records[i].yV);
+			}
+			if (method == 0)
+				for (vector<Record>::iterator i = records.begin(); i != records.end(); i++) {
+					Vertex v = grid.getVertex(i->x, i->y, i->l, i->d);
+					grid.mapPoint(v.x, v.y, i->xV, i->yV, true);
+				}
+			else {
+				store.refresh();
+				for (unsigned int c = 0; c < store.chunks.size(); c++) {
+					const RecordChunk &k = store.chunks[c];
+					for (int i = 0; i < store.chunkSize(c); i++)
+						grid.mapPoint(k.endX[i], k.endY[i], k.xV[i], k.yV[i], true);
+				}
+			}
+		}
+		double seconds = benchmarkSeconds(start);
+		if (method == 0) first = grid;
+
+		bool identical = grid.width == first.width && grid.height == first.height;
+		for (int y = 0; y < grid.height && identical; y++)
+			for (int x = 0; x < grid.width; x++)
+				if (grid.at(x, y) != first.at(x, y)) identical = false;
+		cout << (method == 0 ? "vector" : "store") << "\t" << seconds * 1000 << "\t" << (identical ? "yes" : "no") << endl;
+	}
+}
+
+/*
+Times rebuilding the grid from every record of a long run, then from the records kept by retention.
+The records are of the walls of a 20m room, seen from a robot crossing it back and forth, with a beacon every 200 records.
+Variances grow between beacons, and the records before each beacon are decimated as it is seen.
+Grids starting coarser than the minimum granularity are run too, one never splitting and one splitting as it maps.
+Compares the cells of each tolerance with those of every record from the same start, at the granularity both came to.
+*/
+void benchmarkRetention() {
+	cout << "Rebuild after 100000 records" << endl;
+	cout << "start\tdeterminant\ttolerance\tbudget\trecords\tdecimate ms\trebuild ms\tforced merges\ttolerance reached\tgranularity\tworst error" << endl;
+
+	vector<Record> records = roomRecords(100000, 20000, 0);
+	float variance = 0;
+	for (unsigned int i = 0; i < records.size(); i++) {
+		if (i % 200 == 0) variance = 0;
+		records[i].xV = variance;
+		records[i].yV = variance;
+		variance += 0.00001f;
+	}
+
+	Grid full;
+	//Each rebuild keeping every record is compared with those after it.
+	const bool every[] = {true, false, false, false, true, false, true, false};
+	const double starts[] = {0.1, 0.1, 0.1, 0.1, 0.4, 0.4, 0.4, 0.4};
+	const double determinants[] = {1, 1, 1, 1, 1, 1, 0.75, 0.75};
+	const double tolerances[] = {0, 0, 0.01, 0.01, 0, 0.01, 0, 0.01};
+	const int budgets[] = {0, 0, 0, 20000, 0, 0, 0, 0};
+	for (int t = 0; t < 8; t++) {
+		RecordStore data;
+		Grid grid(starts[t], 0.1, determinants[t], &data);
+		Retention retention(budgets[t], tolerances[t]);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (unsigned int i = 0; i < records.size(); i++) {
+			data.push_back(records[i]);
+			if (!every[t] && records[i].xV == 0 && data.size() > 1) retention.decimate(data, data.size() - 1, grid);
+		}
+		double decimating = benchmarkSeconds(start);
+
+		start = chrono::steady_clock::now();
+		grid.remap();
+		double seconds = benchmarkSeconds(start);
+		if (every[t]) full = grid;
+
+		//The grids may span different extents, so cells are compared by their coords from the world origin.
+		//Grids which came to different granularities cannot be compared cell by cell.
+		string worst = "differs";
+		if (grid.curGran == full.curGran) {
+			int dx = (int)floor((full.xFrom - grid.xFrom) / grid.curGran + 0.5), dy = (int)floor((full.yFrom - grid.yFrom) / grid.curGran + 0.5);
+			double error = 0;
+			for (int y = 0; y < full.height; y++)
+				for (int x = 0; x < full.width; x++) {
+					bool inside = x + dx >= 0 && y + dy >= 0 && x + dx < grid.width && y + dy < grid.height;
+					error = max(error, fabs(full.at(x, y) - (inside ? grid.at(x + dx, y + dy) : 0)));
+				}
+			worst = to_string(error);
+		}
+		cout << starts[t] << "\t" << determinants[t] << "\t" << (every[t] ? string("all") : to_string(tolerances[t])) << "\t" << budgets[t] << "\t"
+			<< data.size() << "\t" << decimating * 1000 << "\t" << seconds * 1000 << "\t" << retention.forced << "\t" << retention.reached << "\t" << grid.curGran << "\t" << worst << endl;
+	}
+}
+
+/*
+Times the kalman update of each beacon over a run of 100000 records, with a beacon every 10000.
+The robot drives a square, the estimate drifting from the truth until each beacon fixes it.
+The rewind builds the reverse records back to the previous beacon then fuses and maps each, as nextLidar once did.
+The smoother fuses as it runs back, mapping the records fused as one batch, all at once or 500 per reading.
+Reports the longest any one reading took, and checks that every method gives the same poses.
+*/
+void benchmarkSmoother() {
+	cout << "Kalman updates over 100000 records" << endl;
+	cout << "method	budget	total ms	worst reading ms	identical" << endl;
+
+	const float mNoise = 0.01f;
+	vector<Record> records;
+	Random random(1);
+	float trueX = 0, trueY = 0, x = 0, y = 0, xV = 0, yV = 0;
+	for (int i = 0; i < 100000; i++) {
+		float b = (float)(90 * ((i / 2500) % 4));
+		if (i % 10000 == 0) { x = trueX; y = trueY; xV = 0; yV = 0; }
+		float l = (float)(360 * random.uniform());
+		records.push_back(Record(x, y, b, l, (float)(2 + 8 * random.uniform()), xV, yV));
+		float dx = 0.004f * (float)cos(b * PI / 180), dy = 0.004f * (float)sin(b * PI / 180);
+		trueX += dx; trueY += dy;
+		x += dx * (float)(1 + 0.1 * (random.uniform() - 0.5)); y += dy * (float)(1 + 0.1 * (random.uniform() - 0.5));
+		xV += fabs(dx) * mNoise; yV += fabs(dy) * mNoise;
+	}
+
+	RecordStore first;
+	const int budgets[] = {0, 0, 500};
+	for (int method = 0; method < 3; method++) {
+		RecordStore data;
+		Grid grid(0.1, 0.1, 1, &data);
+		Smoother smoother;
+		double total = 0, worst = 0;
+		for (unsigned int r = 0; r < records.size(); r++) {
+			//Each record is mapped as it is added, untimed.
+			data.push_back(records[r]);
+			Vertex v = data.endpoint(r);
+			grid.mapPoint(v.x, v.y, records[r].xV, records[r].yV);
+			bool beacon = records[r].xV == 0 && r > 0;
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			if (method == 0 && beacon) {
+				vector<Record> reverse;
+				reverse.push_back(data.back());
+				for (int i = data.size() - 2; !(data.xV(i) == 0 || data.yV(i) == 0); i--) {
+					float dx = data.x(i) - data.x(i + 1);
+					float dy = data.y(i) - data.y(i + 1);
+					float distance = sqrt(dx * dx + dy * dy);
+					float radians = data.b(i - 1) * (float)PI / 180;
+					reverse.push_back(Record(reverse.back().x - distance * cos(radians), reverse.back().y - distance * sin(radians), -1, -1, -1,
+						reverse.back().xV + abs(dx) * mNoise, reverse.back().yV + abs(dy) * mNoise));
+				}
+				for (unsigned int v = 1, d = data.size() - 2; v < reverse.size(); v++, d--) {
+					Record old = data[d];
+					float xVar = old.xV * reverse[v].xV / (old.xV + reverse[v].xV);
+					float yVar = old.yV * reverse[v].yV / (old.yV + reverse[v].yV);
+					data.setPose(d, old.x + (old.xV / (old.xV + reverse[v].xV)) * (reverse[v].x - old.x),
+						old.y + (old.yV / (old.yV + reverse[v].yV)) * (reverse[v].y - old.y), xVar, yVar);
+					Vertex e = data.endpoint(d);
+					grid.mapPoint(e.x, e.y, xVar, yVar, true);
+				}
+			}
+			else if (method > 0) {
+				//A pass still going is finished at the next beacon, before the next begins.
+				for (int pass = 0; pass < (beacon ? 2 : 1); pass++) {
+					if (beacon && pass == 1) smoother.start(data);
+					if (!smoother.active) continue;
+					smoother.step(data, mNoise, (beacon && pass == 0) ? 0 : budgets[method]);
+					grid.beginBatch();
+					for (unsigned int j = 0; j < smoother.fused.size(); j++) {
+						Vertex e = data.endpoint(smoother.fused[j]);
+						grid.mapPoint(e.x, e.y, data.xV(smoother.fused[j]), data.yV(smoother.fused[j]), true);
+					}
+					grid.endBatch();
+					smoother.fused.clear();
+				}
+			}
+			double seconds = benchmarkSeconds(start);
+			total += seconds;
+			worst = max(worst, seconds);
+		}
+		while (smoother.active) smoother.step(data, mNoise, 0);
+		if (method == 0) first = data;
+
+		bool identical = true;
+		for (unsigned int i = 0; i < data.size(); i++)
+			if (data.x(i) != first.x(i) || data.y(i) != first.y(i) || data.xV(i) != first.xV(i) || data.yV(i) != first.yV(i)) identical = false;
+		cout << (method == 0 ? "rewind" : "smoother") << "\t" << budgets[method] << "\t" << total * 1000 << "\t" << worst * 1000 << "\t" << (identical ? "yes" : "no") << endl;
+	}
+}
+
+/*
+Times correcting the grid after each beacon of a run of 40000 records, with a beacon every 2000.
+The robot drives up and back down a corridor 200m long and 4m wide, the estimate drifting from the truth, so the walls seen between beacons are bent until smoothed.
+Mapping the corrected records alone leaves their old hits, repairing rebuilds the tiles they moved out of, and remapping rebuilds every cell.
+Counts the cells left more than 0.01 above those of the remapped grid, and the largest difference either way.
+*/
+void benchmarkRepair() {
+	cout << "Corrections over 40000 records" << endl;
+	cout << "method\tcorrect ms\tghost cells\tworst difference" << endl;
+
+	const float mNoise = 0.01f;
+	vector<Record> records;
+	Random random(1);
+	float trueX = 2, trueY = 2, x = 2, y = 2, xV = 0, yV = 0;
+	for (int i = 0; i < 40000; i++) {
+		float b = (i < 19600) ? 0.0f : 180.0f;
+		if (i % 2000 == 0) { x = trueX; y = trueY; xV = 0; yV = 0; }
+		float l = (float)(360 * random.uniform());
+		double c = cos(l * PI / 180), s = sin(l * PI / 180);
+		double tx = (c > 0) ? (200 - trueX) / c : (c < 0) ? -trueX / c : 1e9;
+		double ty = (s > 0) ? (4 - trueY) / s : (s < 0) ? -trueY / s : 1e9;
+		records.push_back(Record(x, y, b, l, (float)min(tx, ty), xV, yV));
+		float dx = 0.01f * (float)cos(b * PI / 180), dy = 0.01f * (float)sin(b * PI / 180);
+		trueX += dx; trueY += dy;
+		x += dx * 1.05f; y += dy * 1.05f;
+		xV += fabs(dx) * mNoise; yV += fabs(dy) * mNoise;
+	}
+
+	const char *names[] = {"map", "repair", "remap"};
+	vector<Grid> grids(3);
+	vector<RecordStore> stores(3);
+	for (int method = 0; method < 3; method++) {
+		RecordStore &data = stores[method];
+		GridOptions options;
+		options.repair = method == 1;
+		Grid grid(0.1, 0.1, 1, &data, options);
+		Smoother smoother;
+		double total = 0;
+		for (unsigned int r = 0; r < records.size(); r++) {
+			data.push_back(records[r]);
+			Vertex v = data.endpoint(r);
+			grid.mapPoint(v.x, v.y, records[r].xV, records[r].yV);
+			if (records[r].xV != 0 || r == 0) continue;
+
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			if (grid.tileRecords.enabled) grid.indexRecords();
+			smoother.start(data);
+			smoother.step(data, mNoise, 0);
+			if (method == 2) grid.remap();
+			else {
+				grid.beginBatch();
+				for (unsigned int j = 0; j < smoother.fused.size(); j++) {
+					Vertex e = data.endpoint(smoother.fused[j]);
+					grid.mapPoint(e.x, e.y, data.xV(smoother.fused[j]), data.yV(smoother.fused[j]), true);
+				}
+				if (grid.tileRecords.enabled) grid.repair(smoother.fused);
+				grid.endBatch();
+			}
+			smoother.fused.clear();
+			total += benchmarkSeconds(start);
+		}
+		grids[method] = grid;
+
+		//The grids may span different extents, so cells are compared by their coords from the world origin.
+		const Grid &full = grids[2];
+		if (method < 2) {
+			cout << names[method] << "\t" << total * 1000 << endl;
+			continue;
+		}
+		cout << names[method] << "\t" << total * 1000 << "\t0\t0" << endl;
+		for (int m = 0; m < 2; m++) {
+			Grid &g = grids[m];
+			int dx = (int)floor((full.xFrom - g.xFrom) / g.curGran + 0.5), dy = (int)floor((full.yFrom - g.yFrom) / g.curGran + 0.5);
+			int ghosts = 0;
+			double worst = 0;
+			for (int y = 0; y < full.height; y++)
+				for (int x = 0; x < full.width; x++) {
+					bool inside = x + dx >= 0 && y + dy >= 0 && x + dx < g.width && y + dy < g.height;
+					double d = (inside ? g.at(x + dx, y + dy) : 0) - grids[2].at(x, y);
+					if (d > 0.01) ghosts++;
+					worst = max(worst, fabs(d));
+				}
+			cout << names[m] << " cells\t\t" << ghosts << "\t" << worst << endl;
+		}
+	}
+}
+
+//Runs every benchmark.
+void benchmark() {
+	benchmarkCells();
+	benchmarkRemap();
+	benchmarkRebuild();
+	benchmarkSplits();
+	benchmarkSparse();
+	benchmarkCellBits();
+	benchmarkClearance();
+	benchmarkAreas();
+	benchmarkPyramid();
+	benchmarkRecords();
+	benchmarkRetention();
+	benchmarkSmoother();
+	benchmarkRepair();
+}
+
+#endif
\ No newline at end of file
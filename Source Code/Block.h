@@ -0,0 +1,20 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <vector>
+using namespace std;
+
+/*
+A square region of the grid with its own granularity, for refining the grid locally.
+Each level halves the granularity, so a block at level l has (blockCells << l) cells along each side.
+The cells are stored row by row, and left empty until a point is mapped onto the block.
+*/
+class Block {
+public:
+	Block() : level(0) {}
+	static const int blockCells = 8;
+	int level;
+	vector<double> cells;
+};
+
+#endif
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <fstream>
 
 void display(int argc, char **argv, Environment *e, Robot *r);
+void drawCell(int x, int y, double color, int size = 1);
 void displayCallback();
 void graphDisplay();
 void timerCallback(int n);
@@ -322,6 +323,30 @@ void drawQuadrant(int x, int y) {
 	glVertex3f(DisplayB->grid.xFrom + x * incrX + DisplayR->startLocation.x, DisplayB->grid.yFrom + (y + 1) * incrY + DisplayR->startLocation.y, 0);
 }
 
+//Draws a cell of the grid, coloured by its probability.
+//Draws size by size cells from cell x, y.
+void drawCell(int x, int y, double color, int size) {
+	//Calculate cell corner locations.
+	double blX = DisplayB->grid.xFrom + (x - 1) * DisplayB->grid.curGran;
+	double blY = DisplayB->grid.yFrom + (y - 1) * DisplayB->grid.curGran;
+	double brX = DisplayB->grid.xFrom + (x - 1 + size) * DisplayB->grid.curGran;
+	double brY = DisplayB->grid.yFrom + (y - 1) * DisplayB->grid.curGran;
+	double trX = DisplayB->grid.xFrom + (x - 1 + size) * DisplayB->grid.curGran;
+	double trY = DisplayB->grid.yFrom + (y - 1 + size) * DisplayB->grid.curGran;
+	double tlX = DisplayB->grid.xFrom + (x - 1) * DisplayB->grid.curGran;
+	double tlY = DisplayB->grid.yFrom + (y - 1 + size) * DisplayB->grid.curGran;
+
+	//Base the cell colour on point probability.
+	glColor3f(1, 1 - (float)color, 1 - (float)color);
+
+	glBegin(GL_QUADS);
+	glVertex3f(blX + DisplayR->startLocation.x, blY + DisplayR->startLocation.y, 0);
+	glVertex3f(brX + DisplayR->startLocation.x, brY + DisplayR->startLocation.y, 0);
+	glVertex3f(trX + DisplayR->startLocation.x, trY + DisplayR->startLocation.y, 0);
+	glVertex3f(tlX + DisplayR->startLocation.x, tlY + DisplayR->startLocation.y, 0);
+	glEnd();
+}
+
 void displayCallback() {
 	glClear(GL_COLOR_BUFFER_BIT);
 
@@ -336,30 +361,33 @@ void displayCallback() {
 	glEnd();
 
 	//Draw the grid model.
+	//A sparse grid only draws the cells of its tiles, the rest are empty.
+	//With a pyramid, cells smaller than a pixel are drawn from the finest level whose cells are not, each by the largest cell it covers.
 	if (gridE) {
-		for (int y = 0; y < DisplayB->grid.height; y++)
-			for (int x = 0; x < DisplayB->grid.width; x++) {
-				//Calculate cell corner locations.
-				double blX = DisplayB->grid.xFrom + (x - 1) * DisplayB->grid.curGran;
-				double blY = DisplayB->grid.yFrom + (y - 1) * DisplayB->grid.curGran;
-				double brX = DisplayB->grid.xFrom + x * DisplayB->grid.curGran;
-				double brY = DisplayB->grid.yFrom + (y - 1) * DisplayB->grid.curGran;
-				double trX = DisplayB->grid.xFrom + x * DisplayB->grid.curGran;
-				double trY = DisplayB->grid.yFrom + y * DisplayB->grid.curGran;
-				double tlX = DisplayB->grid.xFrom + (x - 1) * DisplayB->grid.curGran;
-				double tlY = DisplayB->grid.yFrom + y * DisplayB->grid.curGran;
-
-				//Base the cell colour on point probability.
-				double color = DisplayB->grid.cells[x][y];
-				glColor3f(1, 1 - color, 1 - color);
-
-				glBegin(GL_QUADS);
-				glVertex3f(blX + DisplayR->startLocation.x, blY + DisplayR->startLocation.y, 0);
-				glVertex3f(brX + DisplayR->startLocation.x, brY + DisplayR->startLocation.y, 0);
-				glVertex3f(trX + DisplayR->startLocation.x, trY + DisplayR->startLocation.y, 0);
-				glVertex3f(tlX + DisplayR->startLocation.x, tlY + DisplayR->startLocation.y, 0);
-				glEnd();
-			}
+		Grid &grid = DisplayB->grid;
+		int level = 0;
+		if (grid.pyramid.enabled) {
+			double pixels = glutGet(GLUT_WINDOW_WIDTH) * grid.curGran / (1.05 * DisplayE->width);
+			grid.refreshPyramid();
+			while (level < grid.pyramid.top() && pixels * (1 << level) < 1) level++;
+		}
+		if (level > 0) {
+			const PyramidLevel &l = grid.pyramid.levels[level - 1];
+			for (int y = l.yFrom; y < l.yFrom + l.height; y++)
+				for (int x = l.xFrom; x < l.xFrom + l.width; x++)
+					drawCell(x * (1 << level) - grid.pyramid.xFrom, y * (1 << level) - grid.pyramid.yFrom, l.maxP[l.index(x, y)], 1 << level);
+		}
+		else if (DisplayB->grid.sparse) {
+			vector<Cell> live;
+			DisplayB->grid.liveCells(live);
+			for (vector<Cell>::iterator i = live.begin(); i != live.end(); i++)
+				drawCell(i->x, i->y, i->p);
+		}
+		else {
+			for (int y = 0; y < DisplayB->grid.height; y++)
+				for (int x = 0; x < DisplayB->grid.width; x++)
+					drawCell(x, y, DisplayB->grid.at(x, y));
+		}
 	}
 
 	//Draw strategy 3's quadrants.
@@ -474,7 +502,7 @@ void displayCallback() {
 		for (unsigned int i = 0; i < DisplayB->data.size(); i++) {
 			//Only draw the points that have tolerable variance.
 			if (DisplayB->toleranceFilter(DisplayB->data[i])) {
-				Vertex v = DisplayB->getVertex(DisplayB->data[i].x, DisplayB->data[i].y, DisplayB->data[i].l, DisplayB->data[i].d);
+				Vertex v = DisplayB->data.endpoint(i);
 				glVertex3f(v.x + DisplayR->startLocation.x, v.y + DisplayR->startLocation.y, 0);
 			}
 		}
@@ -486,7 +514,7 @@ void displayCallback() {
 		glColor3f(0, 1, 0);
 		glBegin(GL_LINE_STRIP);
 		for (unsigned int i = 0; i < DisplayB->data.size(); i++)
-			glVertex3f(DisplayB->data[i].x + DisplayR->startLocation.x, DisplayB->data[i].y + DisplayR->startLocation.y, 0);
+			glVertex3f(DisplayB->data.x(i) + DisplayR->startLocation.x, DisplayB->data.y(i) + DisplayR->startLocation.y, 0);
 		glEnd();
 	}
 
@@ -586,8 +614,8 @@ void displayCallback() {
 		for (unsigned int i = 0; i < DisplayB->data.size(); i++) {
 			//Only draw the points that have tolerable variance.
 			if (DisplayB->toleranceFilter(DisplayB->data[i])) {
-				Vertex v = DisplayB->getVertex(DisplayB->data[i].x, DisplayB->data[i].y, DisplayB->data[i].l, DisplayB->data[i].d);
-				glVertex3f(DisplayB->data[i].x + DisplayR->startLocation.x, DisplayB->data[i].y + DisplayR->startLocation.y, 0);
+				Vertex v = DisplayB->data.endpoint(i);
+				glVertex3f(DisplayB->data.x(i) + DisplayR->startLocation.x, DisplayB->data.y(i) + DisplayR->startLocation.y, 0);
 				glVertex3f(v.x + DisplayR->startLocation.x, v.y + DisplayR->startLocation.y, 0);
 			}
 		}
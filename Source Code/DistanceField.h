@@ -0,0 +1,238 @@
+#ifndef DISTANCEFIELD_H
+#define DISTANCEFIELD_H
+
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <unordered_map>
+#include <math.h>
+#include "Tiles.h"
+using namespace std;
+
+/*
+The squared distances and sites of a square of cells of the distance field.
+*/
+class FieldTile {
+public:
+	vector<int> squared, siteX, siteY;
+};
+
+/*
+The distance from each cell of the grid to the nearest occupied cell, a cell with probability > threshold.
+Each cell keeps its nearest occupied cell, the site, and the squared distance to it in cells, between cell centres.
+Occupied cells are seeded as they are found, then their sites spread outwards to the cells they are nearer to.
+Sites spread no further than range, beyond which cells are far.
+Cells are kept in tiles by their coords from the world origin, like the tiles of a sparse grid, so the field keeps its distances as the grid grows.
+A tile is only kept once a site reaches it, so the field takes memory near occupied cells rather than over the whole extent of the grid.
+Cells falling in a few boxes, as when tiles are repaired, only forget the sites within those boxes, the sites around spreading back over the cells they were nearest to.
+Otherwise the field is reset when cells of the grid fall, or the granularity changes.
+*/
+class DistanceField {
+public:
+	static const int tileCells = Tiles::tileCells;
+	DistanceField() : enabled(false), threshold(0), range(0), stale(true), gran(0), xFrom(0), yFrom(0), width(0), height(0), far(0), lastKey(0), last(0) {}
+	DistanceField(double threshold, double range);
+	DistanceField(const DistanceField &other) { *this = other; }
+	DistanceField &operator=(const DistanceField &other);
+	void reset(double gran, int xFrom, int yFrom, int width, int height);
+	void grow(int newXFrom, int newYFrom, int newWidth, int newHeight);
+	void touch(int xMin, int yMin, int xMax, int yMax);
+	void fall(int xMin, int yMin, int xMax, int yMax);
+	void forget();
+	bool occupied(int x, int y) { return squaredAt(x, y) == 0; }
+	void seed(int x, int y);
+	void propagate();
+	double distance(int x, int y);
+	FieldTile *tileAt(int x, int y, bool create);
+	int squaredAt(int x, int y);
+	void set(int x, int y, int d, int sx, int sy);
+	//
+	bool enabled;
+	double threshold, range;
+	//Set when the field must be reset before it is next read.
+	bool stale;
+	//The granularity and extent of the field, in cells from the world origin.
+	double gran;
+	int xFrom, yFrom, width, height;
+	//The squared distance in cells beyond which cells are far.
+	int far;
+	unordered_map<unsigned long long, FieldTile> tiles;
+	//The tile last found, as neighbouring cells are mostly of the same tile.
+	unsigned long long lastKey;
+	FieldTile *last;
+	//The boxes of cells mapped since the field was last read, four coords to a box.
+	vector<int> dirty;
+	//The boxes of cells which may have fallen since the field was last read, four coords to a box.
+	vector<int> fallen;
+	//Cells to spread, by squared distance and key.
+	priority_queue<pair<int, unsigned long long>, vector<pair<int, unsigned long long> >, greater<pair<int, unsigned long long> > > open;
+};
+
+DistanceField::DistanceField(double threshold, double range) {
+	enabled = true;
+	this->threshold = threshold;
+	this->range = range;
+	stale = true;
+	gran = 0;
+	xFrom = 0; yFrom = 0;
+	width = 0; height = 0;
+	far = 0;
+	lastKey = 0; last = 0;
+}
+
+//Copies the field, the tile last found being found again in the copy.
+DistanceField &DistanceField::operator=(const DistanceField &other) {
+	enabled = other.enabled;
+	threshold = other.threshold; range = other.range;
+	stale = other.stale;
+	gran = other.gran;
+	xFrom = other.xFrom; yFrom = other.yFrom;
+	width = other.width; height = other.height;
+	far = other.far;
+	tiles = other.tiles;
+	lastKey = 0; last = 0;
+	dirty = other.dirty;
+	fallen = other.fallen;
+	open = other.open;
+	return *this;
+}
+
+//Makes every cell of the given extent far, at the given granularity.
+void DistanceField::reset(double gran, int xFrom, int yFrom, int width, int height) {
+	this->gran = gran;
+	this->xFrom = xFrom; this->yFrom = yFrom;
+	this->width = width; this->height = height;
+	int cells = (int)ceil(range / gran);
+	far = cells * cells + 1;
+	tiles.clear();
+	last = 0;
+	dirty.clear();
+	fallen.clear();
+	stale = false;
+}
+
+/*
+Moves the field to the given extent, keeping the distances of the cells it already covered.
+The cells along the old edges then spread their sites again, to the new cells beyond them.
+*/
+void DistanceField::grow(int newXFrom, int newYFrom, int newWidth, int newHeight) {
+	int xMin = max(xFrom, newXFrom), xMax = min(xFrom + width, newXFrom + newWidth);
+	int yMin = max(yFrom, newYFrom), yMax = min(yFrom + height, newYFrom + newHeight);
+	xFrom = newXFrom; yFrom = newYFrom;
+	width = newWidth; height = newHeight;
+
+	for (int y = yMin; y < yMax; y++)
+		for (int x = xMin; x < xMax; x++) {
+			if (x != xMin && x != xMax - 1 && y != yMin && y != yMax - 1) continue;
+			int d = squaredAt(x, y);
+			if (d < far) open.push(make_pair(d, Tiles::key(x, y)));
+		}
+}
+
+//Notes a box of cells which has been mapped, so that any cells it occupied are seeded when the field is next read.
+void DistanceField::touch(int xMin, int yMin, int xMax, int yMax) {
+	dirty.push_back(xMin); dirty.push_back(yMin);
+	dirty.push_back(xMax); dirty.push_back(yMax);
+}
+
+//Notes a box of cells which may have fallen, so that the sites among them are forgotten when the field is next read.
+void DistanceField::fall(int xMin, int yMin, int xMax, int yMax) {
+	fallen.push_back(xMin); fallen.push_back(yMin);
+	fallen.push_back(xMax); fallen.push_back(yMax);
+}
+
+/*
+Makes far every cell within range of a fallen box whose site is in the box, then spreads again the sites of the cells around them.
+The boxes are then touched, so that the cells still occupied in them are seeded again.
+*/
+void DistanceField::forget() {
+	int cells = (int)ceil(range / gran);
+	for (unsigned int b = 0; b < fallen.size(); b += 4)
+		for (int y = fallen[b + 1] - cells; y <= fallen[b + 3] + cells; y++)
+			for (int x = fallen[b] - cells; x <= fallen[b + 2] + cells; x++) {
+				FieldTile *t = tileAt(x, y, false);
+				if (!t) continue;
+				int i = (y - Tiles::tile(y) * tileCells) * tileCells + x - Tiles::tile(x) * tileCells;
+				int sx = t->siteX[i], sy = t->siteY[i];
+				if (t->squared[i] < far && sx >= fallen[b] && sx <= fallen[b + 2] && sy >= fallen[b + 1] && sy <= fallen[b + 3]) t->squared[i] = far;
+			}
+	for (unsigned int b = 0; b < fallen.size(); b += 4) {
+		for (int y = fallen[b + 1] - cells - 1; y <= fallen[b + 3] + cells + 1; y++)
+			for (int x = fallen[b] - cells - 1; x <= fallen[b + 2] + cells + 1; x++) {
+				int d = squaredAt(x, y);
+				if (d < far) open.push(make_pair(d, Tiles::key(x, y)));
+			}
+		touch(fallen[b], fallen[b + 1], fallen[b + 2], fallen[b + 3]);
+	}
+	fallen.clear();
+}
+
+//Finds the tile of a cell, making it with every cell far if asked, otherwise returning 0 if there is none.
+FieldTile *DistanceField::tileAt(int x, int y, bool create) {
+	unsigned long long k = Tiles::key(Tiles::tile(x), Tiles::tile(y));
+	if (last && k == lastKey) return last;
+	unordered_map<unsigned long long, FieldTile>::iterator t = tiles.find(k);
+	if (t == tiles.end()) {
+		if (!create) return 0;
+		FieldTile &made = tiles[k];
+		made.squared.assign(tileCells * tileCells, far);
+		made.siteX.assign(tileCells * tileCells, 0);
+		made.siteY.assign(tileCells * tileCells, 0);
+		t = tiles.find(k);
+	}
+	lastKey = k;
+	last = &t->second;
+	return last;
+}
+
+//The squared distance of a cell to its site, far if its tile has none.
+int DistanceField::squaredAt(int x, int y) {
+	FieldTile *t = tileAt(x, y, false);
+	return t ? t->squared[(y - Tiles::tile(y) * tileCells) * tileCells + x - Tiles::tile(x) * tileCells] : far;
+}
+
+//Gives a cell a site and its squared distance to it.
+void DistanceField::set(int x, int y, int d, int sx, int sy) {
+	FieldTile *t = tileAt(x, y, true);
+	int i = (y - Tiles::tile(y) * tileCells) * tileCells + x - Tiles::tile(x) * tileCells;
+	t->squared[i] = d;
+	t->siteX[i] = sx; t->siteY[i] = sy;
+}
+
+//Makes a cell occupied, to be spread by propagate().
+void DistanceField::seed(int x, int y) {
+	set(x, y, 0, x, y);
+	open.push(make_pair(0, Tiles::key(x, y)));
+}
+
+//Spreads the seeded sites, nearest first, to each neighbour they are nearer to than its own site.
+void DistanceField::propagate() {
+	while (!open.empty()) {
+		pair<int, unsigned long long> top = open.top();
+		open.pop();
+		int x = (int)(unsigned int)(top.second >> 32), y = (int)(unsigned int)top.second;
+		FieldTile *t = tileAt(x, y, false);
+		int i = (y - Tiles::tile(y) * tileCells) * tileCells + x - Tiles::tile(x) * tileCells;
+		//A cell is only spread at its own distance, as it may have been nearer another site or forgotten since it was queued.
+		if (!t || top.first != t->squared[i]) continue;
+		int sx = t->siteX[i], sy = t->siteY[i];
+		for (int dy = -1; dy <= 1; dy++)
+			for (int dx = -1; dx <= 1; dx++) {
+				int nx = x + dx, ny = y + dy;
+				if ((dx == 0 && dy == 0) || nx < xFrom || ny < yFrom || nx >= xFrom + width || ny >= yFrom + height) continue;
+				int d = (nx - sx) * (nx - sx) + (ny - sy) * (ny - sy);
+				if (d >= far || d >= squaredAt(nx, ny)) continue;
+				set(nx, ny, d, sx, sy);
+				open.push(make_pair(d, Tiles::key(nx, ny)));
+			}
+	}
+}
+
+//The distance from a cell to the nearest occupied cell, in the world, at most range.
+double DistanceField::distance(int x, int y) {
+	int d = squaredAt(x, y);
+	return (d >= far) ? range : min(range, sqrt((double)d) * gran);
+}
+
+#endif
\ No newline at end of file
@@ -2,46 +2,221 @@
 #define GRID_H
 
 #include <vector>
+#include <thread>
+#include <algorithm>
+#include <iostream>
 #include <boost/math/distributions/normal.hpp>
-#include "Record.h"
+#include "RecordStore.h"
+#include "Aligned.h"
+#include "Stamp.h"
+#include "Block.h"
+#include "Journal.h"
+#include "Tiles.h"
+#include "LogOdds.h"
+#include "DistanceField.h"
+#include "SummedArea.h"
+#include "Pyramid.h"
+#include "RecordIndex.h"
+#include <emmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 using namespace std;
 using namespace boost::math;
 
-class Cell {
+/*
+Optional settings of a grid, read from the grid element of a configuration.
+stampError: the largest error allowed in a cell probability, so that points may be mapped from cached stamps, 0 maps exactly.
+localRefine: split only the blocks of the grid where adjacent cells exceed the determinant, rather than the whole grid.
+threads: the number of threads that records are mapped across when the grid is rebuilt.
+revert: roll the grid back to the previous kalman when a beacon is seen, rather than remapping every record.
+journalLimit: the most cells logged for a rollback, beyond which the grid is remapped instead.
+batchSplit: split the grid once after the points mapped for each lidar reading, rather than as soon as a point splits it.
+sparse: store the cells in tiles allocated as they are mapped, rather than in one buffer covering every record.
+mapped: keep the tiles of a sparse grid in a temporary file, with only the residentTiles most recently used in memory.
+cellBits: store the cells of a dense grid as log-odds codes of 8 or 16 bits, rather than 64 bit probabilities.
+fusion: how a point is fused into a cell, by the maximum probability, or by adding the log-odds of quantized cells.
+distanceField: keep the distance from each cell to the nearest cell with probability > fieldThreshold, up to fieldRange.
+summedArea: keep summed-area tables of the cells, so that the probabilities over a rectangle are summed in a few lookups.
+pyramid: keep coarser levels of the grid, with the maximum and mean of the cells each covers, for coarse queries and drawing.
+retention: drop settled records which could raise no cell by more than retentionTolerance, keeping at most recordBudget records if it is not 0.
+smoothBudget: the most records smoothed back from a beacon per lidar reading, the rest left to the readings after, 0 smooths them all at once.
+repair: index the records by the tiles they cover, so that a kalman update rebuilds the tiles its records moved out of, unless refining locally or reverting.
+*/
+enum Fusion {FUSE_MAX, FUSE_LOG_ODDS};
+class GridOptions {
 public:
-	Cell(int x, int y, double p) : x(x), y(y), p(p) {}
-	int x, y;
-	double p;
+	GridOptions() : stampError(0), localRefine(false), threads(1), revert(false), journalLimit(1 << 20), batchSplit(false), sparse(false), mapped(false), residentTiles(1024),
+		cellBits(64), fusion(FUSE_MAX), distanceField(false), fieldThreshold(0), fieldRange(4), summedArea(false), pyramid(false),
+		retention(false), recordBudget(0), retentionTolerance(0), smoothBudget(0), repair(false) {}
+	double stampError;
+	bool localRefine;
+	int threads;
+	bool revert;
+	int journalLimit;
+	bool batchSplit;
+	bool sparse;
+	bool mapped;
+	int residentTiles;
+	int cellBits;
+	Fusion fusion;
+	bool distanceField;
+	double fieldThreshold, fieldRange;
+	bool summedArea;
+	bool pyramid;
+	bool retention;
+	int recordBudget;
+	double retentionTolerance;
+	int smoothBudget;
+	bool repair;
+};
+
+/*
+A record as mapped onto the grid, kept while the grid is rebuilt.
+mapped: the record covers cells xCMin to xCMax, yCMin to yCMax.
+profile: where its column then row probabilities are kept.
+hot: some cell probability > determinant, so it may split the grid.
+*/
+class Splat {
+public:
+	Splat(double x, double y, double xSD, double ySD) : x(x), y(y), xSD(xSD), ySD(ySD) {}
+	double x, y, xSD, ySD;
+	bool mapped, hot;
+	int xCMin, xCMax, yCMin, yCMax;
+	size_t profile;
 };
 
 class Grid {
 public:
 	Grid() {}
-	Grid(double startGran, double minGran, double splitDeterminant, vector<Record> *data);
+	Grid(double startGran, double minGran, double splitDeterminant, RecordStore *data, GridOptions options);
 	void mapPoint(double x, double y, double xV, double yV, bool kalman);
 	Vertex getVertex(float x, float y, float l, float d);
 	void remap();
 	int cellX(double worldX);
 	int cellY(double worldY);
+	int cellIndex(double offset, double extent);
 	double worldX(int cellX);
 	double worldY(int cellY);
 	void divide();
 	double completeness();
 	double accuracy();
-	void revert();
+	void begin();
+	bool rollback();
+	void beginBatch();
+	void endBatch();
+	void grow(double newXFrom, double newYFrom, int newWidth, int newHeight);
+	int index(int x, int y) { return (y + originY) * stride + x + originX; }
+	double at(int x, int y) {
+		return local ? localAt(x, y) : sparse ? tiles.at(x + originX, y + originY) : cellBits < 64 ? logOdds.decode(code(index(x, y))) : cells[index(x, y)];
+	}
+	unsigned int code(int i) { return (cellBits == 8) ? codes[i] : ((unsigned short *)&codes[0])[i]; }
+	void setCode(int i, unsigned int c);
+	double fusedAt(int x, int y, double p);
+	double *cellRun(int x, int y, int &n);
+	void mapRun(int x, int y, const double *columnP, double rowP, int n, bool log, int &count, double &sum);
+	template <class T> void fuseCodes(T *row, const double *columnP, double rowP, int n, bool log, int x, int y, int &count, double &sum);
+	void fuseRow(unsigned char *row, const unsigned char *add, int n, int &count, double &sum);
+	void fuseRow(unsigned short *row, const unsigned short *add, int n, int &count, double &sum);
+	template <class T> void fuseTail(T *row, const T *add, int n, int &count, double &sum);
+	void liveCells(vector<Cell> &out);
+	void profile(vector<double> &out, double mean, double sd, int first, int n, double from, double gran, StampCache &cache);
+	bool cellBox(double x, double y, double xSD, double ySD, int &xCMin, int &xCMax, int &yCMin, int &yCMax);
+	bool splat(double x, double y, double xSD, double ySD, bool kalman);
+	void resize();
+	void rebuild();
+	bool replay();
+	void parallel(void (Grid::*part)(int, int, StampCache *), int n);
+	void replayProfiles(int first, int last, StampCache *cache);
+	void replayRows(int rowFrom, int rowTo, StampCache *);
+	void maxRow(double *row, const double *columnP, double rowP, int n, int &count, double &sum);
+	void total(int &n, double &v);
+	void check();
+	bool splitCell(int xCMin, int yCMin, int xCMax, int yCMax, int &splitX, int &splitY);
+	bool splits(int xC, int yC, int xCMin, int yCMin, int xCMax);
+	double mapped(int x, int y, int xC, int yC, int xCMin, int yCMin, int xCMax);
+	void mapLocal(double x, double y, double xSD, double ySD, bool kalman);
+	bool mapBlock(int bx, int by, double x, double y, double xSD, double ySD, bool kalman);
+	void refine(int bx, int by);
+	void growBlocks(int bxMin, int byMin, int bxMax, int byMax);
+	Block *block(int bx, int by);
+	double levelGran(int level) { return startGran / (1 << level); }
+	double blockValue(int bx, int by, int xC, int yC);
+	double localAt(int x, int y);
+	void bounds();
+	void beyondEdge(int &n, double &v);
+	void changed(int xMin, int yMin, int xMax, int yMax);
+	void fallen();
+	double clearance(double x, double y);
+	void refreshField();
+	long long areaUnits(int xMin, int yMin, int xMax, int yMax);
+	double areaSum(int xMin, int yMin, int xMax, int yMax) { return SummedArea::probability(areaUnits(xMin, yMin, xMax, yMax)); }
+	SumTile &sumTile(int tx, int ty);
+	void refreshAreas();
+	double regionMax(int xMin, int yMin, int xMax, int yMax);
+	void refreshPyramid();
+	void updatePyramid(int xMin, int yMin, int xMax, int yMax, int fromLevel);
+	void indexRecords();
+	void repair(const vector<unsigned int> &moved);
+	IndexBox heldCells(const IndexBox &box, const IndexedHit &hit);
+	bool rebuildTile(int tx, int ty, const IndexBox &cells);
+	bool recordProfile(unsigned int i, int xMin, int yMin, int xMax, int yMax, int &xCMin, int &yCMin, int &xCMax, int &yCMax, int &xFirst, int &yFirst, bool &hot);
+	void putCell(int x, int y, double v);
 	//
 	double curGran, minGran;
-	vector<Record> *data;  
+	RecordStore *data;  
 	double xMin, xMax, yMin, yMax; //Points
 	double xFrom, xTo, yFrom, yTo; //Grid
 	int width, height;
-	vector<vector<double>> cells;
-	list<Cell> changedCells;
+	//Cells are stored row by row in a single buffer, each row padded to a cache line.
+	//The buffer has room around the grid to grow into, with cell 0, 0 of the grid at the origin.
+	vector<double, AlignedAllocator<double> > cells;
+	int stride, capacityWidth, capacityHeight;
+	int originX, originY;
+	//A sparse grid stores the cells in tiles instead, with cell 0, 0 of the grid at the origin of the tiles.
+	bool sparse;
+	Tiles tiles;
+	//Quantized cells are stored as codes in place of the cells, in the same layout.
+	int cellBits;
+	Fusion fusion;
+	LogOdds logOdds;
+	vector<unsigned char, AlignedAllocator<unsigned char> > codes;
+	Journal journal;
+	vector<double> columnP, rowP;
+	StampCache stamps;
+	//Records being rebuilt, with their column and row probabilities.
+	int threads;
+	vector<Splat> splats;
+	vector<double> profiles;
+	vector<StampCache> threadStamps;
 	bool firstVector;
 	double splitDeterminant;
+	//The number of non-zero cells and the sum of their probabilities.
+	int cellCount;
+	double cellSum;
+	//Local refinement, the grid is then read at the finest level of any block.
+	//Blocks are stored row by row from block blockX, blockY, which grow like the cells.
+	bool local;
+	double startGran, blockSize;
+	int levels, maxLevel;
+	vector<Block> blocks;
+	int blockX, blockY, blocksWide, blocksHigh;
+	vector<int> levelCount;
+	vector<double> levelSum;
+	//Splits found while batching, of the whole grid or of blocks, which are applied once the batch ends.
+	bool batching, splitPending;
+	vector<pair<int, int> > pendingBlocks;
+	//The number of splits folded into one already pending, each of which would have been a rebuild.
+	int rebuildsSaved;
+	//The distance field, summed-area tables and pyramid, brought up to date with the cells whenever they are read.
+	DistanceField field;
+	SummedArea areas;
+	Pyramid pyramid;
+	//The records covering each tile, so that the tiles records move out of may be rebuilt.
+	RecordIndex tileRecords;
 };
 
-Grid::Grid(double startGran, double minGran, double splitDeterminant, vector<Record> *data) {
+Grid::Grid(double startGran, double minGran, double splitDeterminant, RecordStore *data, GridOptions options = GridOptions()) {
 	this->curGran = startGran;
 	this->minGran = minGran;
 	this->splitDeterminant = splitDeterminant;
@@ -51,7 +226,42 @@ Grid::Grid(double startGran, double minGran, double splitDeterminant, vector<Rec
 	xFrom = 0; xTo = 0;
 	yFrom = 0; yTo = 0;
 	width = 0; height = 0;
+	stride = 0;
+	capacityWidth = 0; capacityHeight = 0;
+	originX = 0; originY = 0;
 	firstVector = true;
+	cellCount = 0; cellSum = 0;
+	stamps = StampCache(options.stampError);
+	threads = options.threads;
+	sparse = options.sparse || options.mapped;
+	if (options.mapped) tiles.map(options.residentTiles);
+	journal = Journal(options.journalLimit);
+	batching = false; splitPending = false;
+	rebuildsSaved = 0;
+	if (options.distanceField) field = DistanceField(options.fieldThreshold, options.fieldRange);
+	areas.enabled = options.summedArea;
+	pyramid.enabled = options.pyramid;
+
+	//Local refinement stops at the last halving of the start granularity no finer than the minimum.
+	local = options.localRefine;
+	tileRecords.enabled = options.repair && !local && !options.revert;
+
+	//Only a dense grid may be quantized, and log-odds may only be added once quantized.
+	cellBits = (options.cellBits == 8 || options.cellBits == 16) ? options.cellBits : 64;
+	fusion = options.fusion;
+	if (fusion == FUSE_LOG_ODDS && cellBits == 64) cellBits = 16;
+	if (sparse || local) cellBits = 64;
+	if (cellBits == 64) fusion = FUSE_MAX;
+	else logOdds = LogOdds(cellBits);
+	this->startGran = startGran;
+	blockSize = startGran * Block::blockCells;
+	levels = 1;
+	while (startGran / (1 << levels) >= minGran) levels++;
+	maxLevel = 0;
+	levelCount.assign(levels, 0);
+	levelSum.assign(levels, 0);
+	blockX = 0; blockY = 0;
+	blocksWide = 0; blocksHigh = 0;
 }
 
 //Maps the given point onto the grid.
@@ -72,119 +282,441 @@ void Grid::mapPoint(double x, double y, double xV, double yV, bool kalman = fals
 	if (yVMin < yMin) yMin = yVMin;
 	else if (yVMax > yMax) yMax = yVMax;
 
+	if (local) {
+		mapLocal(x, y, xSD, ySD, kalman);
+
+		//A cell of a coarser block spreads over the finer cells it covers, up to a cell at the start granularity.
+		if (field.enabled || areas.enabled || pyramid.enabled) {
+			int margin = (int)ceil(startGran / curGran);
+			changed((int)floor(xVMin / curGran) - margin, (int)floor(yVMin / curGran) - margin,
+				(int)floor(xVMax / curGran) + margin, (int)floor(yVMax / curGran) + margin);
+		}
+		return;
+	}
+
 	//Check if we need to resize.
 	if (xMin < xFrom || xMax > xTo || yMin < yFrom || yMax > yTo || firstVector) {
-		firstVector = false;
+		//A new granularity has an empty array, so remap all points and return.
+		if (firstVector) {
+			rebuild();
+			return;
+		}
 
-		//Calculate from/to.
-		xFrom = floor(xMin / curGran) * curGran;
-		xTo = ceil(xMax / curGran) * curGran;
-		yFrom = floor(yMin / curGran) * curGran;
-		yTo = ceil(yMax / curGran) * curGran;
+		//Otherwise keep the cells, grown to the new size, and carry on mapping the point.
+		//Cells are logged by position, so the journal is lost.
+		resize();
+		journal.invalidate();
+	}
 
-		//Calculate width and height.
-		width = abs((int)ceil(xMax / curGran)) + abs((int)floor(xMin / curGran)) + 1;
-		height = abs((int)ceil(yMax / curGran)) + abs((int)floor(yMin / curGran)) + 1;
+	//Split granularity if adjacent cells have probability > determinant.
+	//While batching the split is left until the batch ends, unless already at the minimum.
+	if (splat(x, y, xSD, ySD, kalman)) {
+		if (!batching) divide();
+		else if (curGran != minGran) {
+			if (splitPending) rebuildsSaved++;
+			splitPending = true;
+		}
+	}
+}
 
-		//Resize the array.
-		cells.resize(width);
-		for (int i = 0; i < width; i++)
-			cells[i].resize(height);
+//Calculates the cells within the 3sd box of a point, kept within the array, returns false if there are none.
+bool Grid::cellBox(double x, double y, double xSD, double ySD, int &xCMin, int &xCMax, int &yCMin, int &yCMax) {
+	//Calculate cell min/max coords.
+	xCMin = cellX(x - 3 * xSD);
+	xCMax = cellX(x + 3 * xSD);
+	yCMin = cellY(y - 3 * ySD);
+	yCMax = cellY(y + 3 * ySD);
 
-		//Remap all points and return.
-		remap();
-		return;
+	//Keep the bounding box within the array.
+	if (xCMax > width - 1) xCMax = width - 1;
+	if (yCMax > height - 1) yCMax = height - 1;
+	return xCMax >= xCMin && yCMax >= yCMin;
+}
+
+/*
+Maps a point onto the cells of the array, returning true if adjacent cells have probability > determinant.
+The point is mapped up to and including the first cell where this happens, when the grid would split.
+*/
+bool Grid::splat(double x, double y, double xSD, double ySD, bool kalman) {
+	int xCMin, xCMax, yCMin, yCMax;
+	if (!cellBox(x, y, xSD, ySD, xCMin, xCMax, yCMin, yCMax)) return false;
+	int columns = xCMax - xCMin + 1;
+
+	//The probability of a cell is the product of the probability of its column and of its row.
+	//So the cdf is only evaluated once per grid line, rather than four times per cell.
+	profile(columnP, x, xSD, xCMin, columns, xFrom, curGran, stamps);
+	profile(rowP, y, ySD, yCMin, yCMax - yCMin + 1, yFrom, curGran, stamps);
+
+	//Combine probability independently. DEPRECATED
+	//Problem: Causes 'over exposure' when multipass measurements.
+	//if (addition) cells[xC][yC] = 1 - (1 - cells[xC][yC]) * (1 - p);
+	//else  cells[xC][yC] = (cells[xC][yC] - p) / (1 - p);
+
+	int splitX, splitY;
+	splitCell(xCMin, yCMin, xCMax, yCMax, splitX, splitY);
+
+	//Loop through rows of bounding box, stopping at the cell which splits the grid.
+	for (int yC = yCMin; yC <= yCMax; yC++) {
+		int n = (yC == splitY) ? splitX - xCMin + 1 : columns;
+		mapRun(xCMin, yC, &columnP[0], rowP[yC - yCMin], n, !kalman && journal.recording(), cellCount, cellSum);
+		if (yC == splitY) break;
+	}
+	if (field.enabled || areas.enabled || pyramid.enabled) {
+		int x0 = (int)floor(xFrom / curGran + 0.5), y0 = (int)floor(yFrom / curGran + 0.5);
+		changed(xCMin + x0, yCMin + y0, xCMax + x0, yCMax + y0);
 	}
 
-	//Calculate cell min/max coords.
-	int xCMin = cellX(xVMin);
-	int xCMax = cellX(xVMax);
-	int yCMin = cellY(yVMin);
-	int yCMax = cellY(yVMax);
+	return splitY >= 0;
+}
 
-	//Loop through cells of bounding box.
-	for (int yC = yCMin; yC <= yCMax; yC++)
+/*
+Finds the first cell of the box of the current point, in the order cells are mapped, where adjacent cells have probability > determinant.
+Returns false, with splitX and splitY -1, if there is none.
+*/
+bool Grid::splitCell(int xCMin, int yCMin, int xCMax, int yCMax, int &splitX, int &splitY) {
+	//No cell of a row can exceed the row probability, so most rows are skipped.
+	//Adding log-odds may take any cell over the determinant, so the cell is tested as it would be once fused.
+	bool summed = fusion == FUSE_LOG_ODDS;
+	splitX = -1; splitY = -1;
+	for (int yC = yCMin; yC <= yCMax; yC++) {
+		if (!summed && rowP[yC - yCMin] <= splitDeterminant) continue;
 		for (int xC = xCMin; xC <= xCMax; xC++) {
-			//Calculate probability of current cell.
-			double pX, pY;
-			if (xSD == 0) pX = 1;
-			else {
-				normal_distribution<double> xNormal(x, xSD);
-				pX = cdf(xNormal, worldX(xC + 1)) - cdf(xNormal, worldX(xC));
+			double p = columnP[xC - xCMin] * rowP[yC - yCMin];
+			if (summed) p = fusedAt(xC, yC, p);
+			if (p > splitDeterminant && splits(xC, yC, xCMin, yCMin, xCMax)) {
+				splitX = xC; splitY = yC;
+				return true;
 			}
-			if (ySD == 0) pY = 1;
-			else {
-				normal_distribution<double> yNormal(y, ySD);
-				pY = cdf(yNormal, worldY(yC + 1)) - cdf(yNormal, worldY(yC));
+		}
+	}
+	return false;
+}
+
+//Tests if the cell of the current point has an adjacent cell with probability > determinant.
+bool Grid::splits(int xC, int yC, int xCMin, int yCMin, int xCMax) {
+	//Test surrounding cells are contained within grid.
+	bool left = false, right = false, bottom = false, top = false;
+	if (xC - 1 >= 0) left = true;
+	if (xC + 1 < width) right = true;
+	if (yC - 1 >= 0) bottom = true;
+	if (yC + 1 < height) top = true;
+
+	//Orthogonal cells.
+	if (left && mapped(xC - 1, yC, xC, yC, xCMin, yCMin, xCMax) > splitDeterminant) return true;
+	if (right && mapped(xC + 1, yC, xC, yC, xCMin, yCMin, xCMax) > splitDeterminant) return true;
+	if (bottom && mapped(xC, yC - 1, xC, yC, xCMin, yCMin, xCMax) > splitDeterminant) return true;
+	if (top && mapped(xC, yC + 1, xC, yC, xCMin, yCMin, xCMax) > splitDeterminant) return true;
+
+	//Diagonal cells.
+	if (left && bottom && mapped(xC - 1, yC - 1, xC, yC, xCMin, yCMin, xCMax) > splitDeterminant) return true;
+	if (left && top && mapped(xC - 1, yC + 1, xC, yC, xCMin, yCMin, xCMax) > splitDeterminant) return true;
+	if (right && bottom && mapped(xC + 1, yC - 1, xC, yC, xCMin, yCMin, xCMax) > splitDeterminant) return true;
+	if (right && top && mapped(xC + 1, yC + 1, xC, yC, xCMin, yCMin, xCMax) > splitDeterminant) return true;
+	return false;
+}
+
+//The probability of a cell at the time the cell xC, yC of the current point is mapped.
+//Cells of the point before xC, yC have already been mapped, the rest have not.
+double Grid::mapped(int x, int y, int xC, int yC, int xCMin, int yCMin, int xCMax) {
+	if (x < xCMin || x > xCMax || y < yCMin || y > yC || (y == yC && x >= xC)) return at(x, y);
+	return fusedAt(x, y, columnP[x - xCMin] * rowP[y - yCMin]);
+}
+
+//The probability of a cell once a point with probability p there is fused into it.
+double Grid::fusedAt(int x, int y, double p) {
+	if (cellBits == 64) {
+		double v = at(x, y);
+		return (v > p) ? v : p;
+	}
+	return logOdds.decode(logOdds.fuse(code(index(x, y)), logOdds.encode(p), fusion == FUSE_LOG_ODDS));
+}
+
+/*
+Fills out with the probability of each of n cells from the first along one axis, with cells of the given granularity.
+A cell covers from its grid line to the next, so n + 1 cdfs are needed, unless read from a stamp.
+*/
+void Grid::profile(vector<double> &out, double mean, double sd, int first, int n, double from, double gran, StampCache &cache) {
+	out.resize(n);
+	if (sd == 0) {
+		fill(out.begin(), out.end(), 1.0);
+		return;
+	}
+
+	//Read from a cached stamp if one is close enough.
+	double u = (mean - from) / gran;
+	double cell = floor(u);
+	const Stamp *stamp = cache.find(sd / gran, u - cell);
+	if (stamp) {
+		int k = first - (int)cell - stamp->first;
+		int size = (int)stamp->p.size();
+		for (int i = 0; i < n; i++, k++)
+			out[i] = (k >= 0 && k < size) ? stamp->p[k] : 0;
+		return;
+	}
+
+	boost::math::normal_distribution<double> normal(mean, sd);
+	double lower = cdf(normal, from + gran * first);
+	for (int i = 0; i < n; i++) {
+		double upper = cdf(normal, from + gran * (first + i + 1));
+		out[i] = upper - lower;
+		lower = upper;
+	}
+}
+
+/*
+Maps a run of n cells of row y from cell x, logging their previous values if asked.
+A sparse grid splits the run across tiles, which are mapped a run of cells at a time.
+Quantized cells are fused from their codes.
+*/
+void Grid::mapRun(int x, int y, const double *columnP, double rowP, int n, bool log, int &count, double &sum) {
+	if (cellBits == 8) {
+		fuseCodes(&codes[index(x, y)], columnP, rowP, n, log, x, y, count, sum);
+		return;
+	}
+	if (cellBits == 16) {
+		fuseCodes((unsigned short *)&codes[0] + index(x, y), columnP, rowP, n, log, x, y, count, sum);
+		return;
+	}
+	for (int i = 0, run; i < n; i += run) {
+		double *row = cellRun(x + i, y, run);
+		run = min(run, n - i);
+
+		//Log the previous cell values, so they may be rolled back.
+		//Cells are restored in reverse, so there is no need to check for containment.
+		if (log)
+			for (int j = 0; j < run; j++)
+				journal.log(x + i + j, y, row[j]);
+
+		//Set probability to maximum of current cell or calculated probability.
+		maxRow(row, columnP + i, rowP, run, count, sum);
+	}
+}
+
+//Encodes the probabilities of a run of quantized cells, then fuses them into the cells, a chunk at a time.
+//The codes of the cells are logged, rather than their probabilities.
+template <class T> void Grid::fuseCodes(T *row, const double *columnP, double rowP, int n, bool log, int x, int y, int &count, double &sum) {
+	const int chunk = 256;
+	T add[chunk];
+	for (int i = 0; i < n; i += chunk) {
+		int m = min(chunk, n - i);
+		for (int j = 0; j < m; j++)
+			add[j] = (T)logOdds.encode(columnP[i + j] * rowP);
+		if (log)
+			for (int j = 0; j < m; j++)
+				journal.log(x + i + j, y, row[i + j]);
+		fuseRow(row + i, add, m, count, sum);
+	}
+}
+
+/*
+Fuses codes into a row of 8 bit cells, 16 cells at a time, saturating.
+Codes only rise, so only the cells which changed are decoded for the totals.
+*/
+void Grid::fuseRow(unsigned char *row, const unsigned char *add, int n, int &count, double &sum) {
+	bool summed = fusion == FUSE_LOG_ODDS;
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i old = _mm_loadu_si128((const __m128i *)(row + i));
+		__m128i a = _mm_loadu_si128((const __m128i *)(add + i));
+		__m128i p = summed ? _mm_adds_epu8(old, a) : _mm_max_epu8(old, a);
+		int changed = ~_mm_movemask_epi8(_mm_cmpeq_epi8(old, p)) & 0xFFFF;
+		if (!changed) continue;
+		unsigned char before[16];
+		_mm_storeu_si128((__m128i *)before, old);
+		_mm_storeu_si128((__m128i *)(row + i), p);
+		for (int j = 0; j < 16; j++)
+			if (changed & (1 << j)) {
+				if (before[j] == 0) count++;
+				sum += logOdds.decode(row[i + j]) - logOdds.decode(before[j]);
 			}
-			double p = pX * pY;
-
-			//Combine probability independently. DEPRECATED
-			//Problem: Causes 'over exposure' when multipass measurements.
-			//if (addition) cells[xC][yC] = 1 - (1 - cells[xC][yC]) * (1 - p);
-			//else  cells[xC][yC] = (cells[xC][yC] - p) / (1 - p);
-
-			//Store the previous cell value in changedCells.
-			//Pushing to the front means we don't need to check for containment.
-			//Reducing complexity to n rather than n^2 when reverting.
-			if (!kalman) changedCells.push_front(Cell(xC, yC, cells[xC][yC]));
-
-			//Set probability to maximum of current cell or calculated probability.
-			cells[xC][yC] = (cells[xC][yC] > p) ? cells[xC][yC] : p;
-
-			//Split granularity if adjacent cells have probability > determinant.
-			if (p > splitDeterminant) {
-				//Test surrounding cells are contained within grid.
-				bool left = false, right = false, bottom = false, top = false;
-				if (xC - 1 >= 0) left = true;
-				if (xC + 1 < width) right = true;
-				if (yC - 1 >= 0) bottom = true;
-				if (yC + 1 < height) top = true;
-
-				//Orthogonal cells.
-				if (left && cells[xC - 1][yC] > splitDeterminant) { divide(); return; }
-				if (right && cells[xC + 1][yC] > splitDeterminant) { divide(); return; }
-				if (bottom && cells[xC][yC - 1] > splitDeterminant) { divide(); return; }
-				if (top && cells[xC][yC + 1] > splitDeterminant) { divide(); return; }
-
-				//Diagonal cells.
-				if (left && bottom && cells[xC - 1][yC - 1] > splitDeterminant) { divide(); return; }
-				if (left && top && cells[xC - 1][yC + 1] > splitDeterminant) { divide(); return; }
-				if (right && bottom && cells[xC + 1][yC - 1] > splitDeterminant) { divide(); return; }
-				if (right && top && cells[xC + 1][yC + 1] > splitDeterminant) { divide(); return; }
+	}
+	fuseTail(row + i, add + i, n - i, count, sum);
+}
+
+//Fuses codes into a row of 16 bit cells, 8 cells at a time, saturating.
+//There is no unsigned 16 bit maximum before SSE4.1, so the codes are offset to take a signed maximum.
+void Grid::fuseRow(unsigned short *row, const unsigned short *add, int n, int &count, double &sum) {
+	bool summed = fusion == FUSE_LOG_ODDS;
+	__m128i sign = _mm_set1_epi16((short)0x8000);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i old = _mm_loadu_si128((const __m128i *)(row + i));
+		__m128i a = _mm_loadu_si128((const __m128i *)(add + i));
+		__m128i p = summed ? _mm_adds_epu16(old, a) :
+			_mm_xor_si128(_mm_max_epi16(_mm_xor_si128(old, sign), _mm_xor_si128(a, sign)), sign);
+		int changed = ~_mm_movemask_epi8(_mm_cmpeq_epi16(old, p)) & 0xFFFF;
+		if (!changed) continue;
+		unsigned short before[8];
+		_mm_storeu_si128((__m128i *)before, old);
+		_mm_storeu_si128((__m128i *)(row + i), p);
+		for (int j = 0; j < 8; j++)
+			if (changed & (1 << (2 * j))) {
+				if (before[j] == 0) count++;
+				sum += logOdds.decode(row[i + j]) - logOdds.decode(before[j]);
 			}
+	}
+	fuseTail(row + i, add + i, n - i, count, sum);
+}
+
+//Fuses codes into the cells left over from fuseRow, one at a time.
+template <class T> void Grid::fuseTail(T *row, const T *add, int n, int &count, double &sum) {
+	bool summed = fusion == FUSE_LOG_ODDS;
+	for (int i = 0; i < n; i++) {
+		T p = (T)logOdds.fuse(row[i], add[i], summed);
+		if (p == row[i]) continue;
+		if (row[i] == 0) count++;
+		sum += logOdds.decode(p) - logOdds.decode(row[i]);
+		row[i] = p;
+	}
+}
+
+//Sets the code of quantized cell i.
+void Grid::setCode(int i, unsigned int c) {
+	if (cellBits == 8) codes[i] = (unsigned char)c;
+	else ((unsigned short *)&codes[0])[i] = (unsigned short)c;
+}
+
+/*
+Sets each of n cells of a row to the maximum of itself and its column probability times the row probability.
+Adds the cells which become non-zero to count, and the increase in probability to sum.
+*/
+void Grid::maxRow(double *row, const double *columnP, double rowP, int n, int &count, double &sum) {
+	int i = 0;
+	double sums[4] = {0, 0, 0, 0};
+#ifdef __AVX__
+	__m256d r4 = _mm256_set1_pd(rowP), zero4 = _mm256_setzero_pd(), sum4 = _mm256_setzero_pd();
+	for (; i + 4 <= n; i += 4) {
+		__m256d old = _mm256_loadu_pd(row + i);
+		__m256d p = _mm256_max_pd(old, _mm256_mul_pd(_mm256_loadu_pd(columnP + i), r4));
+		_mm256_storeu_pd(row + i, p);
+		sum4 = _mm256_add_pd(sum4, _mm256_sub_pd(p, old));
+		int filled = _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(old, zero4, _CMP_EQ_OQ), _mm256_cmp_pd(p, zero4, _CMP_NEQ_UQ)));
+		count += (filled & 1) + ((filled >> 1) & 1) + ((filled >> 2) & 1) + (filled >> 3);
+	}
+	_mm256_storeu_pd(sums, sum4);
+#endif
+	__m128d r2 = _mm_set1_pd(rowP), zero2 = _mm_setzero_pd(), sum2 = _mm_setzero_pd();
+	for (; i + 2 <= n; i += 2) {
+		__m128d old = _mm_loadu_pd(row + i);
+		__m128d p = _mm_max_pd(old, _mm_mul_pd(_mm_loadu_pd(columnP + i), r2));
+		_mm_storeu_pd(row + i, p);
+		sum2 = _mm_add_pd(sum2, _mm_sub_pd(p, old));
+		int filled = _mm_movemask_pd(_mm_and_pd(_mm_cmpeq_pd(old, zero2), _mm_cmpneq_pd(p, zero2)));
+		count += (filled & 1) + (filled >> 1);
+	}
+	double sums2[2];
+	_mm_storeu_pd(sums2, sum2);
+	sum += (sums[0] + sums[1]) + (sums[2] + sums[3]) + (sums2[0] + sums2[1]);
+	for (; i < n; i++) {
+		double p = columnP[i] * rowP;
+		if (row[i] < p) {
+			if (row[i] == 0) count++;
+			sum += p - row[i];
+			row[i] = p;
+		}
+	}
+}
+
+/*
+Moves the grid to start at the given world coords with the given size, keeping the cells.
+Grid lines are multiples of the granularity, so the cells move by whole cells.
+The buffer only grows when the grid outgrows it, then to twice the size needed, to leave room either side.
+*/
+void Grid::grow(double newXFrom, double newYFrom, int newWidth, int newHeight) {
+	//Tiles are kept by world coords, so a sparse grid only moves its origin, and has no room to grow into.
+	if (sparse) {
+		if (capacityWidth == 0) tiles.clear();
+		xFrom = newXFrom; yFrom = newYFrom;
+		width = newWidth; height = newHeight;
+		capacityWidth = newWidth; capacityHeight = newHeight;
+		originX = (int)floor(xFrom / curGran + 0.5);
+		originY = (int)floor(yFrom / curGran + 0.5);
+		return;
+	}
+
+	//The position of the old cell 0, 0 in the new grid.
+	int dx = (int)floor((xFrom - newXFrom) / curGran + 0.5);
+	int dy = (int)floor((yFrom - newYFrom) / curGran + 0.5);
+	int newOriginX = originX - dx;
+	int newOriginY = originY - dy;
+
+	if (capacityWidth == 0 || newOriginX < 0 || newOriginY < 0 ||
+		newOriginX + newWidth > capacityWidth || newOriginY + newHeight > capacityHeight) {
+		int newCapacityWidth = newWidth * 2, newCapacityHeight = newHeight * 2;
+		int newStride = (newCapacityWidth + 7) & ~7;
+		newOriginX = newWidth / 2;
+		newOriginY = newHeight / 2;
+
+		//Copy the rows of the old grid, byte by byte for quantized cells.
+		if (cellBits < 64) {
+			int bytes = cellBits / 8;
+			vector<unsigned char, AlignedAllocator<unsigned char> > newCodes(newStride * newCapacityHeight * bytes, 0);
+			if (capacityWidth != 0)
+				for (int y = 0; y < height; y++)
+					copy(codes.begin() + index(0, y) * bytes, codes.begin() + index(width, y) * bytes,
+						newCodes.begin() + ((y + dy + newOriginY) * newStride + dx + newOriginX) * bytes);
+			codes.swap(newCodes);
+		}
+		else {
+			vector<double, AlignedAllocator<double> > newCells(newStride * newCapacityHeight, 0);
+			if (capacityWidth != 0)
+				for (int y = 0; y < height; y++)
+					copy(cells.begin() + index(0, y), cells.begin() + index(width, y),
+						newCells.begin() + (y + dy + newOriginY) * newStride + dx + newOriginX);
+			cells.swap(newCells);
 		}
+		stride = newStride;
+		capacityWidth = newCapacityWidth;
+		capacityHeight = newCapacityHeight;
+	}
+
+	xFrom = newXFrom; yFrom = newYFrom;
+	width = newWidth; height = newHeight;
+	originX = newOriginX; originY = newOriginY;
 }
 
 //Clears the array and remaps all points.
 void Grid::remap() {
+	if (!local) {
+		rebuild();
+		return;
+	}
+
 	//Clear.
-	for (int y = 0; y < height; y++)
-		for (int x = 0; x < width; x++)
-			cells[x][y] = 0;
-	changedCells.clear();
+	for (vector<Block>::iterator i = blocks.begin(); i != blocks.end(); i++)
+		fill(i->cells.begin(), i->cells.end(), 0.0);
+	fill(levelCount.begin(), levelCount.end(), 0);
+	fill(levelSum.begin(), levelSum.end(), 0.0);
+	journal.invalidate();
+	fallen();
 	
-	//Iterate through data and map points.
-	for (vector<Record>::iterator i = data->begin(); i != data->end(); i++) {
-		Vertex v = getVertex(i->x, i->y, i->l, i->d);
-		mapPoint(v.x, v.y, i->xV, i->yV);
+	//Stream the hits of the records, a chunk at a time.
+	data->refresh();
+	for (unsigned int c = 0; c < data->chunks.size(); c++) {
+		const RecordChunk &k = data->chunks[c];
+		for (int i = 0; i < data->chunkSize(c); i++)
+			mapPoint(k.endX[i], k.endY[i], k.xV[i], k.yV[i]);
 	}
 }
 
 //Calculates the x cell coord of a world coord.
+//The first grid line at or beyond the coord, clamped to one past the last line.
 int Grid::cellX(double worldX) {
-	int x = 0;
-	for (double i = xFrom; i <= xTo; i += curGran, x++)
-		if (i >= worldX) return x;
-	return x;
+	return cellIndex(worldX - xFrom, xTo - xFrom);
 }
 
 //Calculates the y cell coord of a world coord.
 int Grid::cellY(double worldY) {
-	int y = 0;
-	for (double i = yFrom; i <= yTo; i += curGran, y++)
-		if (i >= worldY) return y;
-	return y;
+	return cellIndex(worldY - yFrom, yTo - yFrom);
+}
+
+//Calculates a cell coord from an offset into the grid by division rather than stepping.
+//Offsets within a billionth of a cell of a grid line are treated as on the line.
+int Grid::cellIndex(double offset, double extent) {
+	if (offset <= 0) return 0;
+	int lines = (int)floor(extent / curGran + 0.5) + 1;
+	double cell = ceil(offset / curGran - 0.000000001);
+	return (cell < lines) ? (int)cell : lines;
 }
 
 //Calculates the x world coord of a cell coord.
@@ -199,10 +731,7 @@ double Grid::worldY(int cellY) {
 
 //Calculates the vertex at a lidar intercept.
 Vertex Grid::getVertex(float x, float y, float l, float d) {
-	float radians = l * (float)PI / 180;
-	float vX = x + d * cos(radians);
-	float vY = y + d * sin(radians);
-	return Vertex(vX, vY);
+	return RecordStore::hit(x, y, l, d);
 }
 
 //Divides the granularity in two and remaps points.
@@ -212,47 +741,986 @@ void Grid::divide() {
 	curGran /= 2;
 	if (curGran < minGran) curGran = minGran;
 
-	//Reset the vector.
-	cells.clear();
-	firstVector = true;
-	changedCells.clear();
-	
-	//Iterate through data and map points.
-	for (vector<Record>::iterator i = data->begin(); i != data->end(); i++) {
-		Vertex v = getVertex(i->x, i->y, i->l, i->d);
-		mapPoint(v.x, v.y, i->xV, i->yV);
+	//Rebuild the array at the new granularity.
+	rebuild();
+}
+
+//Sizes the array to cover the mins/maxes, keeping the cells.
+void Grid::resize() {
+	//Calculate from/to.
+	double newXFrom = floor(xMin / curGran) * curGran;
+	double newYFrom = floor(yMin / curGran) * curGran;
+	xTo = ceil(xMax / curGran) * curGran;
+	yTo = ceil(yMax / curGran) * curGran;
+
+	//Calculate width and height.
+	int newWidth = abs((int)ceil(xMax / curGran)) + abs((int)floor(xMin / curGran)) + 1;
+	int newHeight = abs((int)ceil(yMax / curGran)) + abs((int)floor(yMin / curGran)) + 1;
+	grow(newXFrom, newYFrom, newWidth, newHeight);
+}
+
+/*
+Clears the array and maps every record at the current granularity, halving it while the records split the grid.
+The mins/maxes are first set from every record, so that the array is sized once per granularity.
+*/
+void Grid::rebuild() {
+	splats.clear();
+	data->refresh();
+	for (unsigned int c = 0; c < data->chunks.size(); c++) {
+		const RecordChunk &k = data->chunks[c];
+		for (int i = 0; i < data->chunkSize(c); i++) {
+			Splat s(k.endX[i], k.endY[i], sqrt(k.xV[i]), sqrt(k.yV[i]));
+			splats.push_back(s);
+
+			//Set mins/maxes, as mapping the record would.
+			if (s.x - 3 * s.xSD < xMin) xMin = s.x - 3 * s.xSD;
+			else if (s.x + 3 * s.xSD > xMax) xMax = s.x + 3 * s.xSD;
+			if (s.y - 3 * s.ySD < yMin) yMin = s.y - 3 * s.ySD;
+			else if (s.y + 3 * s.ySD > yMax) yMax = s.y + 3 * s.ySD;
+		}
+	}
+
+	firstVector = false;
+	while (true) {
+		//Start from an empty array.
+		capacityWidth = 0; capacityHeight = 0;
+		resize();
+		journal.invalidate();
+		fallen();
+
+		//Limit granuliarty to minimum.
+		if (!replay() || curGran == minGran) {
+			total(cellCount, cellSum);
+			return;
+		}
+		curGran /= 2;
+		if (curGran < minGran) curGran = minGran;
+	}
+}
+
+/*
+Maps every record onto the empty array, returning true if they split the grid.
+Only records with a cell probability > determinant can split the grid, and these are mapped last, in order, as mapPoint would.
+The others are mapped first and cannot raise a cell above the determinant, so they have no effect on where the grid splits.
+Taking the maximum gives the same cells in any order, so these are mapped across threads.
+Each thread first finds the probabilities of a share of the records, then maps these onto a band of rows.
+*/
+bool Grid::replay() {
+	//Find the cells of each record, and where to keep its probabilities.
+	size_t size = 0;
+	for (vector<Splat>::iterator s = splats.begin(); s != splats.end(); s++) {
+		s->hot = false;
+		s->mapped = cellBox(s->x, s->y, s->xSD, s->ySD, s->xCMin, s->xCMax, s->yCMin, s->yCMax);
+		s->profile = size;
+		if (s->mapped) size += (s->xCMax - s->xCMin + 1) + (s->yCMax - s->yCMin + 1);
+	}
+	profiles.resize(size);
+
+	//Threads may not allocate tiles at once, so every tile mapped is allocated first.
+	if (sparse)
+		for (vector<Splat>::iterator s = splats.begin(); s != splats.end(); s++)
+			if (s->mapped) tiles.touch(s->xCMin + originX, s->yCMin + originY, s->xCMax + originX, s->yCMax + originY);
+
+	parallel(&Grid::replayProfiles, (int)splats.size());
+	//Tiles paged in by one thread could page out those of another, so a mapped grid maps the rows on one thread.
+	if (tiles.file) replayRows(0, height, &stamps);
+	else parallel(&Grid::replayRows, height);
+
+	//At the minimum granularity a record which splits the grid is mapped up to the cell where it does.
+	for (vector<Splat>::iterator s = splats.begin(); s != splats.end(); s++)
+		if (s->hot && splat(s->x, s->y, s->xSD, s->ySD, true) && curGran != minGran)
+			return true;
+	return false;
+}
+
+//Runs part of a rebuild over n items, giving each thread an even share of them and its own stamps.
+void Grid::parallel(void (Grid::*part)(int, int, StampCache *), int n) {
+	if (threads <= 1) {
+		(this->*part)(0, n, &stamps);
+		return;
+	}
+
+	//Stamps hold the same probabilities whichever cache they are found in.
+	if ((int)threadStamps.size() != threads) threadStamps.assign(threads, StampCache(stamps.error));
+	vector<thread> workers;
+	for (int t = 0; t < threads; t++)
+		workers.push_back(thread(part, this, n * t / threads, n * (t + 1) / threads, &threadStamps[t]));
+	for (int t = 0; t < threads; t++)
+		workers[t].join();
+}
+
+//Finds the column and row probabilities of the records from first up to last, marking those which may split the grid.
+void Grid::replayProfiles(int first, int last, StampCache *cache) {
+	vector<double> xP, yP;
+	for (int i = first; i < last; i++) {
+		Splat &s = splats[i];
+		if (!s.mapped) continue;
+		int columns = s.xCMax - s.xCMin + 1, rows = s.yCMax - s.yCMin + 1;
+		profile(xP, s.x, s.xSD, s.xCMin, columns, xFrom, curGran, *cache);
+		profile(yP, s.y, s.ySD, s.yCMin, rows, yFrom, curGran, *cache);
+		copy(xP.begin(), xP.end(), profiles.begin() + s.profile);
+		copy(yP.begin(), yP.end(), profiles.begin() + s.profile + columns);
+
+		//The largest cell probability is the product of the largest column and row probabilities.
+		//Adding log-odds may take any cell over the determinant, so then every record is mapped in order.
+		s.hot = fusion == FUSE_LOG_ODDS || *max_element(xP.begin(), xP.end()) * *max_element(yP.begin(), yP.end()) > splitDeterminant;
+	}
+}
+
+//Maps the rows from rowFrom up to rowTo of the records which cannot split the grid.
+//The totals are found once the rebuild is done, so that they do not depend on the threads.
+void Grid::replayRows(int rowFrom, int rowTo, StampCache *) {
+	int count = 0;
+	double sum = 0;
+	for (vector<Splat>::iterator s = splats.begin(); s != splats.end(); s++) {
+		if (!s->mapped || s->hot || s->yCMax < rowFrom || s->yCMin >= rowTo) continue;
+		int columns = s->xCMax - s->xCMin + 1;
+		const double *xP = &profiles[s->profile], *yP = xP + columns;
+		for (int yC = max(s->yCMin, rowFrom); yC <= s->yCMax && yC < rowTo; yC++)
+			mapRun(s->xCMin, yC, xP, yP[yC - s->yCMin], columns, false, count, sum);
 	}
 }
 
 //Calculates the ratio of non-zero grid cells.
+//The non-zero cells are counted as they are mapped.
+//Refining locally, a block cell counts every finer cell it covers, even those beyond the edge of the grid.
 double Grid::completeness() {
-	int n = 0;
-	for (int y = 0; y < height; y++)
-		for (int x = 0; x < width; x++)
-			if (cells[x][y] != 0)
-				n++;
-	return float(n) / width / height;
+#ifdef GRID_DEBUG
+	check();
+#endif
+	if (local) {
+		int n = 0;
+		for (int l = 0; l < levels; l++)
+			n += levelCount[l] << (2 * (maxLevel - l));
+		return float(n) / width / height;
+	}
+	return float(cellCount) / width / height;
 }
 
 //Calculates the average variance of all non-zero cells.
 double Grid::accuracy() {
-	int n = 0;
-	double v = 0;
-	for (int y = 0; y < height; y++)
+#ifdef GRID_DEBUG
+	check();
+#endif
+	if (local) {
+		int n = 0;
+		double v = 0;
+		for (int l = 0; l < levels; l++) {
+			n += levelCount[l] << (2 * (maxLevel - l));
+			v += levelSum[l];
+		}
+		return 1 - v / double(n);
+	}
+	return 1 - cellSum / double(cellCount);
+}
+
+//Counts the non-zero cells and sums their probabilities, by scanning every cell.
+void Grid::total(int &n, double &v) {
+	n = 0;
+	v = 0;
+	if (local) {
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++) {
+				double p = at(x, y);
+				if (p != 0) {
+					n++;
+					v += p;
+				}
+			}
+		beyondEdge(n, v);
+		return;
+	}
+	if (sparse) {
+		for (unordered_map<unsigned long long, Tile>::iterator t = tiles.tiles.begin(); t != tiles.tiles.end(); t++) {
+			const double *p = tiles.cells(t->second);
+			for (int i = 0; i < Tiles::tileCells * Tiles::tileCells; i++)
+				if (p[i] != 0) {
+					n++;
+					v += p[i];
+				}
+		}
+		return;
+	}
+	if (cellBits < 64) {
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++) {
+				unsigned int c = code(index(x, y));
+				if (c != 0) {
+					n++;
+					v += logOdds.decode(c);
+				}
+			}
+		return;
+	}
+	for (int y = 0; y < height; y++) {
+		const double *row = &cells[index(0, y)];
 		for (int x = 0; x < width; x++)
-			if (cells[x][y] != 0) {
+			if (row[x] != 0) {
 				n++;
-				v += cells[x][y];
+				v += row[x];
 			}
-	return 1 - v / double(n);
+	}
+}
+
+//Finds cell x, y, and the number of cells n from it which are stored one after another.
+//A sparse grid allocates the tile of the cell if need be.
+double *Grid::cellRun(int x, int y, int &n) {
+	if (sparse) return tiles.run(x + originX, y + originY, n);
+	n = width - x;
+	return &cells[index(x, y)];
 }
 
-//Revert the grid to the previous kalman.
-void Grid::revert() {
-	while (!changedCells.empty()) {
-		cells[changedCells.front().x][changedCells.front().y] = changedCells.front().p;
-		changedCells.pop_front();
+//Lists the cells with any probability, visiting only the tiles of a sparse grid.
+void Grid::liveCells(vector<Cell> &out) {
+	out.clear();
+	if (sparse) {
+		for (unordered_map<unsigned long long, Tile>::iterator t = tiles.tiles.begin(); t != tiles.tiles.end(); t++) {
+			const double *p = tiles.cells(t->second);
+			for (int i = 0; i < Tiles::tileCells * Tiles::tileCells; i++) {
+				int x = t->second.x + i % Tiles::tileCells - originX, y = t->second.y + i / Tiles::tileCells - originY;
+				if (p[i] != 0 && x >= 0 && y >= 0 && x < width && y < height)
+					out.push_back(Cell(x, y, p[i]));
+			}
+		}
+		return;
+	}
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			if (at(x, y) != 0) out.push_back(Cell(x, y, at(x, y)));
+}
+
+//Checks the totals kept as cells are mapped against scanning every cell.
+void Grid::check() {
+	int n = 0, count = 0;
+	double v = 0, sum = 0;
+	total(n, v);
+	if (local)
+		for (int l = 0; l < levels; l++) {
+			count += levelCount[l] << (2 * (maxLevel - l));
+			sum += levelSum[l];
+		}
+	else {
+		count = cellCount;
+		sum = cellSum;
+	}
+	if (n != count || fabs(v - sum) > 0.000001 * (1 + fabs(v)))
+		cout << "Grid totals " << count << ", " << sum << " do not match cells " << n << ", " << v << endl;
+}
+
+//Begins logging the cells changed, so that they may be rolled back.
+void Grid::begin() {
+	journal.begin();
+}
+
+/*
+Reverts the cells changed since begin(), returning false if they could not be.
+When refining locally the cells are logged by block and position within it.
+*/
+bool Grid::rollback() {
+	int mark = journal.start();
+	if (mark < 0) {
+		journal.discard();
+		return false;
+	}
+
+	//Restore the cells latest first, so each ends with its value from before the epoch.
+	for (int i = (int)journal.cells.size() - 1; i >= mark; i--) {
+		Cell &c = journal.cells[i];
+		if (!local && cellBits < 64) {
+			//Quantized cells are logged by their codes.
+			int k = index(c.x, c.y);
+			unsigned int old = code(k), restored = (unsigned int)c.p;
+			if (old == 0 && restored != 0) cellCount++;
+			if (old != 0 && restored == 0) cellCount--;
+			cellSum += logOdds.decode(restored) - logOdds.decode(old);
+			setCode(k, restored);
+			continue;
+		}
+		double *cell;
+		int *count;
+		double *sum;
+		if (local) {
+			Block &b = blocks[c.x];
+			cell = &b.cells[c.y];
+			count = &levelCount[b.level];
+			sum = &levelSum[b.level];
+		}
+		else {
+			int run;
+			cell = cellRun(c.x, c.y, run);
+			count = &cellCount;
+			sum = &cellSum;
+		}
+		if (*cell == 0 && c.p != 0) (*count)++;
+		if (*cell != 0 && c.p == 0) (*count)--;
+		*sum += c.p - *cell;
+		*cell = c.p;
+	}
+	journal.discard();
+	fallen();
+	return true;
+}
+
+/*
+Begins a batch of points, during which the grid is not split.
+Each split would rebuild the grid, or a block, from every record, and the next point may well split it again.
+*/
+void Grid::beginBatch() {
+	batching = true;
+}
+
+//Ends a batch, splitting the grid once if any point of the batch split it, then each block which was split.
+//A rebuild keeps halving the granularity until the records no longer split the grid, so one is enough.
+void Grid::endBatch() {
+	batching = false;
+	if (splitPending) {
+		splitPending = false;
+		divide();
+	}
+	for (vector<pair<int, int> >::iterator i = pendingBlocks.begin(); i != pendingBlocks.end(); i++)
+		refine(i->first, i->second);
+	pendingBlocks.clear();
+}
+
+//Maps a point onto each block it covers, refining the blocks which it splits.
+void Grid::mapLocal(double x, double y, double xSD, double ySD, bool kalman) {
+	int bxMin = (int)floor((x - 3 * xSD) / blockSize);
+	int bxMax = (int)floor((x + 3 * xSD) / blockSize);
+	int byMin = (int)floor((y - 3 * ySD) / blockSize);
+	int byMax = (int)floor((y + 3 * ySD) / blockSize);
+	growBlocks(bxMin, byMin, bxMax, byMax);
+	bounds();
+
+	for (int by = byMin; by <= byMax; by++)
+		for (int bx = bxMin; bx <= bxMax; bx++) {
+			if (!mapBlock(bx, by, x, y, xSD, ySD, kalman)) continue;
+			if (!batching) refine(bx, by);
+			else if (find(pendingBlocks.begin(), pendingBlocks.end(), make_pair(bx, by)) != pendingBlocks.end()) rebuildsSaved++;
+			else pendingBlocks.push_back(make_pair(bx, by));
+		}
+}
+
+/*
+Maps a point onto the cells of a block, at the granularity of the block.
+Returns true if adjacent cells have probability > determinant, and the block may be split.
+*/
+bool Grid::mapBlock(int bx, int by, double x, double y, double xSD, double ySD, bool kalman) {
+	Block &b = *block(bx, by);
+	double gran = levelGran(b.level);
+	int n = Block::blockCells << b.level;
+	double blockXFrom = bx * blockSize, blockYFrom = by * blockSize;
+
+	//Calculate cell min/max coords within the block.
+	int xCMin = max(0, (int)floor((x - 3 * xSD - blockXFrom) / gran));
+	int xCMax = min(n - 1, (int)floor((x + 3 * xSD - blockXFrom) / gran));
+	int yCMin = max(0, (int)floor((y - 3 * ySD - blockYFrom) / gran));
+	int yCMax = min(n - 1, (int)floor((y + 3 * ySD - blockYFrom) / gran));
+	int columns = xCMax - xCMin + 1;
+	if (columns <= 0 || yCMax < yCMin) return false;
+
+	if (b.cells.empty()) b.cells.assign(n * n, 0);
+	profile(columnP, x, xSD, xCMin, columns, blockXFrom, gran, stamps);
+	profile(rowP, y, ySD, yCMin, yCMax - yCMin + 1, blockYFrom, gran, stamps);
+
+	int blockIndex = (by - blockY) * blocksWide + bx - blockX;
+	for (int yC = yCMin; yC <= yCMax; yC++) {
+		double *row = &b.cells[yC * n + xCMin];
+		if (!kalman && journal.recording())
+			for (int i = 0; i < columns; i++)
+				journal.log(blockIndex, yC * n + xCMin + i, row[i]);
+		maxRow(row, &columnP[0], rowP[yC - yCMin], columns, levelCount[b.level], levelSum[b.level]);
+	}
+
+	//Split if adjacent cells have probability > determinant, unless already at the minimum.
+	if (b.level == levels - 1) return false;
+	for (int yC = yCMin; yC <= yCMax; yC++) {
+		if (rowP[yC - yCMin] <= splitDeterminant) continue;
+		for (int xC = xCMin; xC <= xCMax; xC++) {
+			if (columnP[xC - xCMin] * rowP[yC - yCMin] <= splitDeterminant) continue;
+			for (int dy = -1; dy <= 1; dy++)
+				for (int dx = -1; dx <= 1; dx++)
+					if ((dx != 0 || dy != 0) && blockValue(bx, by, xC + dx, yC + dy) > splitDeterminant)
+						return true;
+		}
+	}
+	return false;
+}
+
+//Splits a block until no point splits it again, remapping only the records which cover it.
+void Grid::refine(int bx, int by) {
+	Block &b = *block(bx, by);
+	double blockXFrom = bx * blockSize, blockYFrom = by * blockSize;
+	bool split = true;
+	while (split && b.level < levels - 1) {
+		//Take the cells of the block out of the totals.
+		for (vector<double>::iterator p = b.cells.begin(); p != b.cells.end(); p++)
+			if (*p != 0) {
+				levelCount[b.level]--;
+				levelSum[b.level] -= *p;
+			}
+		b.level++;
+		int n = Block::blockCells << b.level;
+		b.cells.assign(n * n, 0);
+		if (b.level > maxLevel) {
+			maxLevel = b.level;
+			curGran = levelGran(maxLevel);
+			bounds();
+		}
+
+		split = false;
+		for (unsigned int i = 0; i < data->size() && !split; i++) {
+			Vertex v = data->endpoint(i);
+			double xSD = sqrt(data->xV(i)), ySD = sqrt(data->yV(i));
+			if (v.x + 3 * xSD < blockXFrom || v.x - 3 * xSD >= blockXFrom + blockSize) continue;
+			if (v.y + 3 * ySD < blockYFrom || v.y - 3 * ySD >= blockYFrom + blockSize) continue;
+			split = mapBlock(bx, by, v.x, v.y, xSD, ySD, true);
+		}
+	}
+
+	//Cells are logged at the old granularity of the block, so the journal is lost.
+	//Its cells are spread anew, so they may have fallen.
+	journal.invalidate();
+	fallen();
+}
+
+//Grows the blocks to include the given block coords, to twice the size needed.
+void Grid::growBlocks(int bxMin, int byMin, int bxMax, int byMax) {
+	if (blocksWide > 0) {
+		if (bxMin >= blockX && byMin >= blockY && bxMax < blockX + blocksWide && byMax < blockY + blocksHigh) return;
+		bxMin = min(bxMin, blockX); byMin = min(byMin, blockY);
+		bxMax = max(bxMax, blockX + blocksWide - 1); byMax = max(byMax, blockY + blocksHigh - 1);
+	}
+	int w = bxMax - bxMin + 1, h = byMax - byMin + 1;
+	int newBlockX = bxMin - w / 2, newBlockY = byMin - h / 2;
+	int newBlocksWide = w * 2, newBlocksHigh = h * 2;
+
+	//Move the blocks, swapping rather than copying their cells.
+	vector<Block> newBlocks(newBlocksWide * newBlocksHigh);
+	for (int y = 0; y < blocksHigh; y++)
+		for (int x = 0; x < blocksWide; x++) {
+			Block &from = blocks[y * blocksWide + x];
+			Block &to = newBlocks[(y + blockY - newBlockY) * newBlocksWide + x + blockX - newBlockX];
+			to.level = from.level;
+			to.cells.swap(from.cells);
+		}
+	blocks.swap(newBlocks);
+	blockX = newBlockX; blockY = newBlockY;
+	blocksWide = newBlocksWide; blocksHigh = newBlocksHigh;
+
+	//Cells are logged by block, so the journal is lost.
+	journal.invalidate();
+}
+
+//Finds the block at the given block coords, or NULL if it is outside of the grid.
+Block *Grid::block(int bx, int by) {
+	if (bx < blockX || by < blockY || bx >= blockX + blocksWide || by >= blockY + blocksHigh) return NULL;
+	return &blocks[(by - blockY) * blocksWide + bx - blockX];
+}
+
+//Finds the probability of a cell of a block, which may lie over the edge in a neighbouring block.
+double Grid::blockValue(int bx, int by, int xC, int yC) {
+	Block *b = block(bx, by);
+	int n = Block::blockCells << b->level;
+	if (xC >= 0 && yC >= 0 && xC < n && yC < n) return b->cells[yC * n + xC];
+
+	//Find the block under the centre of the cell.
+	double gran = levelGran(b->level);
+	double x = bx * blockSize + (xC + 0.5) * gran;
+	double y = by * blockSize + (yC + 0.5) * gran;
+	bx = (int)floor(x / blockSize);
+	by = (int)floor(y / blockSize);
+	b = block(bx, by);
+	if (!b || b->cells.empty()) return 0;
+	n = Block::blockCells << b->level;
+	gran = levelGran(b->level);
+	xC = min(n - 1, max(0, (int)floor((x - bx * blockSize) / gran)));
+	yC = min(n - 1, max(0, (int)floor((y - by * blockSize) / gran)));
+	return b->cells[yC * n + xC];
+}
+
+/*
+Reads a cell at the finest granularity from the block it lies in.
+A coarser cell spreads its probability evenly over the finer cells it covers.
+*/
+double Grid::localAt(int x, int y) {
+	double wX = xFrom + (x + 0.5) * curGran;
+	double wY = yFrom + (y + 0.5) * curGran;
+	int bx = (int)floor(wX / blockSize);
+	int by = (int)floor(wY / blockSize);
+	Block *b = block(bx, by);
+	if (!b || b->cells.empty()) return 0;
+	int n = Block::blockCells << b->level;
+	double gran = levelGran(b->level);
+	int xC = min(n - 1, max(0, (int)floor((wX - bx * blockSize) / gran)));
+	int yC = min(n - 1, max(0, (int)floor((wY - by * blockSize) / gran)));
+	int r = 1 << (maxLevel - b->level);
+	return b->cells[yC * n + xC] / (r * r);
+}
+
+//Calculates from/to and width/height at the finest granularity, when refining locally.
+void Grid::bounds() {
+	xFrom = floor(xMin / curGran) * curGran;
+	xTo = ceil(xMax / curGran) * curGran;
+	yFrom = floor(yMin / curGran) * curGran;
+	yTo = ceil(yMax / curGran) * curGran;
+	width = abs((int)ceil(xMax / curGran)) + abs((int)floor(xMin / curGran)) + 1;
+	height = abs((int)ceil(yMax / curGran)) + abs((int)floor(yMin / curGran)) + 1;
+}
+
+/*
+Counts the finer cells of block cells which lie beyond the edge of the grid, and sums their share of each probability, when refining locally.
+The totals kept per level count every finer cell a block cell covers, while at() only reads those within the grid.
+*/
+void Grid::beyondEdge(int &n, double &v) {
+	for (int by = blockY; by < blockY + blocksHigh; by++)
+		for (int bx = blockX; bx < blockX + blocksWide; bx++) {
+			Block &b = *block(bx, by);
+			if (b.cells.empty()) continue;
+			int cellsPerSide = Block::blockCells << b.level;
+			int r = 1 << (maxLevel - b.level);
+
+			//The finest cell coords of the corner of the block.
+			int x0 = (int)floor((bx * blockSize - xFrom) / curGran + 0.5);
+			int y0 = (int)floor((by * blockSize - yFrom) / curGran + 0.5);
+			for (int yC = 0; yC < cellsPerSide; yC++)
+				for (int xC = 0; xC < cellsPerSide; xC++) {
+					double p = b.cells[yC * cellsPerSide + xC];
+					if (p == 0) continue;
+					int w = max(0, min(width, x0 + (xC + 1) * r) - max(0, x0 + xC * r));
+					int h = max(0, min(height, y0 + (yC + 1) * r) - max(0, y0 + yC * r));
+					n += r * r - w * h;
+					v += p / (r * r) * (r * r - w * h);
+				}
+		}
+}
+
+/*
+The distance from a world coord to the nearest cell with probability > threshold, at most the range of the field.
+Measured between cell centres, from the cell containing the coord, or 0 outside the grid.
+*/
+double Grid::clearance(double x, double y) {
+	refreshField();
+	if (x < xFrom || y < yFrom || x > xTo || y > yTo) return 0;
+	int xC = cellX(x), yC = cellY(y);
+	if (xC >= width || yC >= height) return 0;
+	return field.distance(xC + field.xFrom, yC + field.yFrom);
+}
+
+/*
+Brings the distance field up to date with the cells, moving it to the extent of the grid.
+The cells mapped since it was last read are seeded where occupied, as cells only rise between resets.
+Once the granularity changes or cells may have fallen, the field is reset and every cell is seeded.
+*/
+void Grid::refreshField() {
+	int x0 = (int)floor(xFrom / curGran + 0.5), y0 = (int)floor(yFrom / curGran + 0.5);
+	if (field.stale || field.gran != curGran) {
+		field.reset(curGran, x0, y0, width, height);
+		if (sparse) {
+			vector<Cell> live;
+			liveCells(live);
+			for (unsigned int i = 0; i < live.size(); i++)
+				if (live[i].p > field.threshold) field.seed(live[i].x + x0, live[i].y + y0);
+		}
+		else
+			for (int y = 0; y < height; y++)
+				for (int x = 0; x < width; x++)
+					if (at(x, y) > field.threshold) field.seed(x + x0, y + y0);
+		field.propagate();
+		return;
 	}
+
+	//Cells which fell lose their sites, and are seeded again below where still occupied.
+	if (!field.fallen.empty()) field.forget();
+
+	//Blocks may hold cells beyond the old extent, so the cells the field grows over are seeded too.
+	if (field.xFrom != x0 || field.yFrom != y0 || field.width != width || field.height != height) {
+		int oldXMin = field.xFrom - x0, oldYMin = field.yFrom - y0;
+		int oldXMax = oldXMin + field.width, oldYMax = oldYMin + field.height;
+		field.grow(x0, y0, width, height);
+		if (local)
+			for (int y = 0; y < height; y++)
+				for (int x = 0; x < width; x++)
+					if ((x < oldXMin || x >= oldXMax || y < oldYMin || y >= oldYMax) && at(x, y) > field.threshold)
+						field.seed(x + x0, y + y0);
+	}
+	for (unsigned int i = 0; i < field.dirty.size(); i += 4) {
+		int xCMin = max(field.dirty[i] - x0, 0), yCMin = max(field.dirty[i + 1] - y0, 0);
+		int xCMax = min(field.dirty[i + 2] - x0, width - 1), yCMax = min(field.dirty[i + 3] - y0, height - 1);
+		for (int y = yCMin; y <= yCMax; y++)
+			for (int x = xCMin; x <= xCMax; x++)
+				if (!field.occupied(x + x0, y + y0) && at(x, y) > field.threshold) field.seed(x + x0, y + y0);
+	}
+	field.dirty.clear();
+	field.propagate();
+}
+
+/*
+Sums the probabilities of the cells from xMin, yMin to xMax, yMax, kept within the grid, in units of 2^-32.
+Each tile covered takes four lookups of its table, found first if it is dirty.
+*/
+long long Grid::areaUnits(int xMin, int yMin, int xMax, int yMax) {
+	refreshAreas();
+	xMin = max(xMin, 0); yMin = max(yMin, 0);
+	xMax = min(xMax, width - 1); yMax = min(yMax, height - 1);
+	if (xMax < xMin || yMax < yMin) return 0;
+
+	const int n = SummedArea::tileCells, w = n + 1;
+	int wxMin = xMin + areas.xFrom, wyMin = yMin + areas.yFrom, wxMax = xMax + areas.xFrom, wyMax = yMax + areas.yFrom;
+	long long sum = 0;
+	for (int ty = Tiles::tile(wyMin); ty <= Tiles::tile(wyMax); ty++)
+		for (int tx = Tiles::tile(wxMin); tx <= Tiles::tile(wxMax); tx++) {
+			const vector<long long> &s = sumTile(tx, ty).sums;
+			int x1 = max(wxMin, tx * n) - tx * n, x2 = min(wxMax, tx * n + n - 1) - tx * n + 1;
+			int y1 = max(wyMin, ty * n) - ty * n, y2 = min(wyMax, ty * n + n - 1) - ty * n + 1;
+			sum += s[y2 * w + x2] - s[y1 * w + x2] - s[y2 * w + x1] + s[y1 * w + x1];
+		}
+	return sum;
+}
+
+//Finds the table of a tile by its tile coords, summing its cells from the first dirty row.
+//The rows of a dense grid of 64 bit cells are read directly, rather than cell by cell.
+SumTile &Grid::sumTile(int tx, int ty) {
+	const int n = SummedArea::tileCells, w = n + 1;
+	SumTile &t = areas.tiles[Tiles::key(tx, ty)];
+	if (t.dirtyFrom >= n) return t;
+	if (t.sums.empty()) t.sums.assign(w * w, 0);
+	int xFirst = tx * n - areas.xFrom;
+	int iMin = max(0, -xFirst), iMax = min(n, width - xFirst);
+	bool direct = !local && !sparse && cellBits == 64;
+	for (int j = t.dirtyFrom; j < n; j++) {
+		int y = ty * n + j - areas.yFrom;
+		long long *sums = &t.sums[(j + 1) * w], *above = &t.sums[j * w];
+		long long row = 0;
+		int i = 0;
+		for (; i < iMin; i++) sums[i + 1] = above[i + 1];
+		if (y >= 0 && y < height) {
+			const double *cell = direct ? &cells[index(xFirst + iMin, y)] : NULL;
+			for (; i < iMax; i++) {
+				row += SummedArea::units(direct ? cell[i - iMin] : at(xFirst + i, y));
+				sums[i + 1] = above[i + 1] + row;
+			}
+		}
+		for (; i < n; i++) sums[i + 1] = above[i + 1] + row;
+	}
+	t.dirtyFrom = n;
+	return t;
+}
+
+/*
+Drops the tables once cells have fallen or the granularity has changed, and follows the grid as it grows.
+Blocks may hold cells beyond the old extent, so when refining locally the tables are dirtied as the grid grows.
+*/
+void Grid::refreshAreas() {
+	int x0 = (int)floor(xFrom / curGran + 0.5), y0 = (int)floor(yFrom / curGran + 0.5);
+	if (areas.stale || areas.gran != curGran) areas.tiles.clear();
+	else if (local && (areas.xFrom != x0 || areas.yFrom != y0 || areas.width != width || areas.height != height)) areas.dirtyAll();
+	areas.stale = false;
+	areas.gran = curGran;
+	areas.xFrom = x0; areas.yFrom = y0;
+	areas.width = width; areas.height = height;
+}
+
+/*
+The largest probability of the cells from xMin, yMin to xMax, yMax, kept within the grid.
+Read from the finest level at which the rectangle spans at most two cells each way, so it may count cells just beyond the rectangle.
+It is 0 only if every cell of the rectangle is.
+*/
+double Grid::regionMax(int xMin, int yMin, int xMax, int yMax) {
+	xMin = max(xMin, 0); yMin = max(yMin, 0);
+	xMax = min(xMax, width - 1); yMax = min(yMax, height - 1);
+	if (xMax < xMin || yMax < yMin) return 0;
+	if ((xMax - xMin + 1) * (yMax - yMin + 1) <= 4) {
+		double m = 0;
+		for (int y = yMin; y <= yMax; y++)
+			for (int x = xMin; x <= xMax; x++)
+				m = max(m, at(x, y));
+		return m;
+	}
+
+	refreshPyramid();
+	int wxMin = xMin + pyramid.xFrom, wyMin = yMin + pyramid.yFrom, wxMax = xMax + pyramid.xFrom, wyMax = yMax + pyramid.yFrom;
+	int l = 1;
+	while (l < pyramid.top() && (Pyramid::down(wxMax, l) - Pyramid::down(wxMin, l) > 1 || Pyramid::down(wyMax, l) - Pyramid::down(wyMin, l) > 1))
+		l++;
+	double m = 0;
+	for (int y = Pyramid::down(wyMin, l); y <= Pyramid::down(wyMax, l); y++)
+		for (int x = Pyramid::down(wxMin, l); x <= Pyramid::down(wxMax, l); x++)
+			m = max(m, pyramid.maxAt(l, x, y));
+	return m;
+}
+
+/*
+Brings the pyramid up to date with the cells, laying its levels out over the extent of the grid.
+The levels above the cells mapped since it was last read are found again, each from the level below.
+Once the granularity changes or cells may have fallen, every level is found again.
+Blocks may hold cells beyond the old extent, so when refining locally every level is found again as the grid grows.
+*/
+void Grid::refreshPyramid() {
+	int x0 = (int)floor(xFrom / curGran + 0.5), y0 = (int)floor(yFrom / curGran + 0.5);
+	int first = 0;
+	if (pyramid.stale || pyramid.gran != curGran) first = pyramid.layout(x0, y0, width, height, false);
+	else if (pyramid.xFrom != x0 || pyramid.yFrom != y0 || pyramid.width != width || pyramid.height != height) {
+		first = pyramid.layout(x0, y0, width, height, true);
+		if (local) first = 1;
+	}
+	pyramid.stale = false;
+	pyramid.gran = curGran;
+
+	if (first != 1)
+		for (unsigned int i = 0; i < pyramid.dirty.size(); i += 4)
+			updatePyramid(pyramid.dirty[i], pyramid.dirty[i + 1], pyramid.dirty[i + 2], pyramid.dirty[i + 3], 1);
+	pyramid.dirty.clear();
+	if (first) updatePyramid(x0, y0, x0 + width - 1, y0 + height - 1, first);
+}
+
+//Finds the cells of each level from fromLevel up covering the given cells, by their coords from the world origin.
+void Grid::updatePyramid(int xMin, int yMin, int xMax, int yMax, int fromLevel) {
+	xMin = max(xMin, pyramid.xFrom); yMin = max(yMin, pyramid.yFrom);
+	xMax = min(xMax, pyramid.xFrom + width - 1); yMax = min(yMax, pyramid.yFrom + height - 1);
+	if (xMax < xMin || yMax < yMin) return;
+	for (int l = fromLevel; l <= pyramid.top(); l++) {
+		if (l > 1) {
+			pyramid.combine(l, xMin, yMin, xMax, yMax);
+			continue;
+		}
+
+		//Level 1 is found from the cells of the grid.
+		PyramidLevel &first = pyramid.levels[0];
+		for (int y = Pyramid::down(yMin, 1); y <= Pyramid::down(yMax, 1); y++)
+			for (int x = Pyramid::down(xMin, 1); x <= Pyramid::down(xMax, 1); x++) {
+				double m = 0, s = 0;
+				for (int yC = max(2 * y, pyramid.yFrom); yC <= min(2 * y + 1, pyramid.yFrom + height - 1); yC++)
+					for (int xC = max(2 * x, pyramid.xFrom); xC <= min(2 * x + 1, pyramid.xFrom + width - 1); xC++) {
+						double p = at(xC - pyramid.xFrom, yC - pyramid.yFrom);
+						m = max(m, p);
+						s += p;
+					}
+				first.maxP[first.index(x, y)] = m;
+				first.sum[first.index(x, y)] = s;
+			}
+	}
+}
+
+//Notes the cells changed, by their coords from the world origin, for the distance field, summed-area tables and pyramid to catch up with.
+void Grid::changed(int xMin, int yMin, int xMax, int yMax) {
+	if (field.enabled) field.touch(xMin, yMin, xMax, yMax);
+	if (areas.enabled) areas.touch(xMin, yMin, xMax, yMax);
+	if (pyramid.enabled) pyramid.touch(xMin, yMin, xMax, yMax);
+}
+
+//Notes that cells may have fallen, so the distance field, summed-area tables and pyramid start again.
+void Grid::fallen() {
+	field.stale = true;
+	areas.stale = true;
+	pyramid.stale = true;
+}
+
+/*
+Brings the index of records by tile up to date with the records, before a kalman update moves any.
+It is found again from every record when the granularity has changed or records were dropped, as the grid was then mapped from them as they are.
+*/
+void Grid::indexRecords() {
+	if (tileRecords.gran != curGran || tileRecords.generation != data->generation) {
+		tileRecords.clear();
+		tileRecords.gran = curGran;
+		tileRecords.generation = data->generation;
+	}
+	for (unsigned int i = tileRecords.boxes.size(); i < data->size(); i++) {
+		Vertex v = data->endpoint(i);
+		tileRecords.add(i, RecordIndex::box(v.x, v.y, data->xV(i), data->yV(i), curGran), IndexedHit(v.x, v.y, data->xV(i), data->yV(i)));
+	}
+}
+
+/*
+Rebuilds the cells the given records moved out of, once they have been mapped where corrected, a tile at a time.
+A record sharp enough to split the grid may have been cut short by an old hit next to it, so its new box is rebuilt too.
+A rebuild of the whole grid since the records were indexed leaves nothing to repair.
+*/
+void Grid::repair(const vector<unsigned int> &moved) {
+	if (tileRecords.gran != curGran) return;
+	for (unsigned int j = 0; j < moved.size(); j++) {
+		unsigned int i = moved[j];
+		Vertex v = data->endpoint(i);
+		double xSD = sqrt(data->xV(i)), ySD = sqrt(data->yV(i));
+		double xPeak = (xSD == 0) ? 1 : curGran / (xSD * 2.50662827), yPeak = (ySD == 0) ? 1 : curGran / (ySD * 2.50662827);
+		IndexBox box = RecordIndex::box(v.x, v.y, data->xV(i), data->yV(i), curGran), held = heldCells(tileRecords.boxes[i], tileRecords.hits[i]);
+		if (xPeak * yPeak > splitDeterminant) held = held.join(box);
+		tileRecords.move(i, box, IndexedHit(v.x, v.y, data->xV(i), data->yV(i)), held);
+	}
+
+	bool split = false;
+	for (map<unsigned long long, IndexBox>::iterator d = tileRecords.dirty.begin(); d != tileRecords.dirty.end(); d++)
+		if (rebuildTile((int)(unsigned int)(d->first >> 32), (int)(unsigned int)d->first, d->second)) split = true;
+	tileRecords.dirty.clear();
+
+	//Split granularity if a record mapped again split it, as a remap would.
+	if (split && curGran != minGran) {
+		if (!batching) divide();
+		else {
+			if (splitPending) rebuildsSaved++;
+			splitPending = true;
+		}
+	}
+}
+
+/*
+The cells of a box, by their coords from the world origin, whose value an old hit may hold, so which may fall once it moves.
+Taking the maximum, a cell above the old probability of the hit holds that of another record, and stays as it is.
+Probabilities from stamps may differ by the stamp error, and the grid lines move by rounding as the grid grows, which for a sharp point changes them by far more than the rounding.
+So a cell within twice the stamp error and 0.0001 of the old probability is held too.
+Adding log-odds, every cell the hit raised holds some of it, as does every cell once a held cell is above the split determinant, where its fall may change where other records split the grid.
+*/
+IndexBox Grid::heldCells(const IndexBox &box, const IndexedHit &hit) {
+	if (fusion == FUSE_LOG_ODDS) return box;
+	int x0 = (int)floor(xFrom / curGran + 0.5), y0 = (int)floor(yFrom / curGran + 0.5);
+	int xMin = max(box.xMin - x0, 0), xMax = min(box.xMax - x0, width - 1);
+	int yMin = max(box.yMin - y0, 0), yMax = min(box.yMax - y0, height - 1);
+	if (xMin > xMax || yMin > yMax) return IndexBox();
+
+	double xSD = sqrt(hit.xV), ySD = sqrt(hit.yV);
+	profile(columnP, hit.x, xSD, xMin, xMax - xMin + 1, xFrom, curGran, stamps);
+	profile(rowP, hit.y, ySD, yMin, yMax - yMin + 1, yFrom, curGran, stamps);
+	IndexBox held;
+	for (int y = yMin; y <= yMax; y++)
+		for (int x = xMin; x <= xMax; x++) {
+			double p = min(columnP[x - xMin] * rowP[y - yMin] + 2 * stamps.error + 0.0001, 1.0), v = at(x, y);
+			if (v == 0 || (cellBits == 64 ? p < v : logOdds.encode(p) < code(index(x, y)))) continue;
+			if (v > splitDeterminant) return box;
+			held = held.join(IndexBox(x + x0, y + y0, x + x0, y + y0));
+		}
+	return held;
+}
+
+/*
+Clears the given cells of a tile, by their coords from the world origin, then maps onto them the records now covering them, as replay would.
+Records which cannot split the grid are mapped first, then those which may, in order, each up to the cell of its box where it splits the grid.
+Whether a record splits the grid depends on the cells around those rebuilt as they were when it was mapped.
+So if any record may split it, the whole tile is rebuilt, as a split may hang on any cell of it, and the ring of cells around it is rebuilt with it, from the records of the tiles around, then put back as it was.
+Cells beyond the ring are read as they stand, so under log-odds fusion, where a split may hang on records far off, the cells may still differ from a remap.
+Records the tile still lists but no longer covers are dropped from its list.
+Returns true if a record split the grid.
+*/
+bool Grid::rebuildTile(int tx, int ty, const IndexBox &cells) {
+	int x0 = (int)floor(xFrom / curGran + 0.5), y0 = (int)floor(yFrom / curGran + 0.5);
+	IndexBox b = cells.clip(IndexBox::tile(tx, ty));
+	int xTMin = max(b.xMin - x0, 0), xTMax = min(b.xMax - x0, width - 1);
+	int yTMin = max(b.yMin - y0, 0), yTMax = min(b.yMax - y0, height - 1);
+	if (xTMin > xTMax || yTMin > yTMax) return false;
+
+	vector<unsigned int> records;
+	unordered_map<unsigned long long, vector<unsigned int> >::iterator t = tileRecords.tiles.find(Tiles::key(tx, ty));
+	if (t != tileRecords.tiles.end()) {
+		vector<unsigned int> &listed = t->second;
+		sort(listed.begin(), listed.end());
+		unsigned int kept = 0;
+		for (unsigned int j = 0; j < listed.size(); j++)
+			if (tileRecords.boxes[listed[j]].tiles().contains(tx, ty)) listed[kept++] = listed[j];
+		listed.resize(kept);
+		records = listed;
+		if (listed.empty()) tileRecords.tiles.erase(t);
+	}
+
+	//Adding log-odds, any record may split the grid, otherwise none can unless the determinant is below 1.
+	bool ring = fusion == FUSE_LOG_ODDS, hot;
+	int xCMin, xCMax, yCMin, yCMax, xFirst, yFirst;
+	for (unsigned int j = 0; j < records.size() && !ring && splitDeterminant < 1; j++)
+		ring = recordProfile(records[j], xTMin, yTMin, xTMax, yTMax, xCMin, yCMin, xCMax, yCMax, xFirst, yFirst, hot) && hot;
+
+	//The records covering the ring are listed by the tiles it covers.
+	int xRMin = xTMin, xRMax = xTMax, yRMin = yTMin, yRMax = yTMax;
+	if (ring) {
+		IndexBox whole = IndexBox::tile(tx, ty);
+		xTMin = max(whole.xMin - x0, 0); xTMax = min(whole.xMax - x0, width - 1);
+		yTMin = max(whole.yMin - y0, 0); yTMax = min(whole.yMax - y0, height - 1);
+		xRMin = max(xTMin - 1, 0); xRMax = min(xTMax + 1, width - 1);
+		yRMin = max(yTMin - 1, 0); yRMax = min(yTMax + 1, height - 1);
+		IndexBox near = IndexBox(xRMin + x0, yRMin + y0, xRMax + x0, yRMax + y0).tiles();
+		for (int y = near.yMin; y <= near.yMax; y++)
+			for (int x = near.xMin; x <= near.xMax; x++) {
+				t = tileRecords.tiles.find(Tiles::key(x, y));
+				if ((x != tx || y != ty) && t != tileRecords.tiles.end()) records.insert(records.end(), t->second.begin(), t->second.end());
+			}
+		sort(records.begin(), records.end());
+		records.erase(unique(records.begin(), records.end()), records.end());
+	}
+
+	//Clear the cells, keeping the ring as it was, by code if quantized.
+	vector<double> around;
+	for (int y = yRMin; y <= yRMax; y++)
+		for (int x = xRMin; x <= xRMax; x++) {
+			if (x < xTMin || x > xTMax || y < yTMin || y > yTMax) around.push_back(cellBits < 64 ? code(index(x, y)) : at(x, y));
+			putCell(x, y, 0);
+		}
+
+	//Records which may split the grid are left for the second pass, as replayProfiles marks them.
+	bool split = false;
+	vector<unsigned int> later;
+	for (int pass = 0; pass < 2; pass++) {
+		const vector<unsigned int> &order = pass == 0 ? records : later;
+		for (unsigned int j = 0; j < order.size(); j++) {
+			if (!recordProfile(order[j], xRMin, yRMin, xRMax, yRMax, xCMin, yCMin, xCMax, yCMax, xFirst, yFirst, hot)) continue;
+			if (pass == 0 && hot) {
+				later.push_back(order[j]);
+				continue;
+			}
+			int splitX = -1, splitY = -1;
+			if (pass == 1 && splitCell(xCMin, yCMin, xCMax, yCMax, splitX, splitY)) split = true;
+
+			//Map the cells of the record within those rebuilt and the ring, stopping at the cell which splits the grid.
+			int xMin = max(xCMin, xRMin), xMax = min(xCMax, xRMax), yMin = max(yCMin, yRMin), yMax = min(yCMax, yRMax);
+			for (int yC = yMin; yC <= yMax && (splitY < 0 || yC <= splitY); yC++) {
+				int last = (yC == splitY) ? min(xMax, splitX) : xMax;
+				if (last >= xMin) mapRun(xMin, yC, &columnP[xMin - xFirst], rowP[yC - yFirst], last - xMin + 1, false, cellCount, cellSum);
+			}
+		}
+	}
+
+	//Put the ring back as it was.
+	unsigned int r = 0;
+	for (int y = yRMin; y <= yRMax; y++)
+		for (int x = xRMin; x <= xRMax; x++)
+			if (x < xTMin || x > xTMax || y < yTMin || y > yTMax) putCell(x, y, around[r++]);
+
+	//Cells may have fallen, so the distance field forgets the sites among them.
+	changed(xTMin + x0, yTMin + y0, xTMax + x0, yTMax + y0);
+	if (field.enabled) field.fall(xTMin + x0, yTMin + y0, xTMax + x0, yTMax + y0);
+	return split;
+}
+
+/*
+Finds the cells of the 3sd box of a record as it now lies, returning false if none are within the given cells.
+A cell takes at most gran / (sd * sqrt(2 pi)) of each axis, sqrt(2 pi) being 2.50662827.
+So only a record sharp enough to be hot has the probabilities of its whole box found, from xFirst, yFirst.
+The others only have those of the cells within found, which is all they need to be mapped.
+*/
+bool Grid::recordProfile(unsigned int i, int xMin, int yMin, int xMax, int yMax, int &xCMin, int &yCMin, int &xCMax, int &yCMax, int &xFirst, int &yFirst, bool &hot) {
+	Vertex v = data->endpoint(i);
+	double xSD = sqrt(data->xV(i)), ySD = sqrt(data->yV(i));
+	if (!cellBox(v.x, v.y, xSD, ySD, xCMin, xCMax, yCMin, yCMax)) return false;
+	if (max(xCMin, xMin) > min(xCMax, xMax) || max(yCMin, yMin) > min(yCMax, yMax)) return false;
+
+	double xPeak = (xSD == 0) ? 1 : curGran / (xSD * 2.50662827), yPeak = (ySD == 0) ? 1 : curGran / (ySD * 2.50662827);
+	hot = fusion == FUSE_LOG_ODDS || xPeak * yPeak > splitDeterminant;
+	xFirst = hot ? xCMin : max(xCMin, xMin);
+	yFirst = hot ? yCMin : max(yCMin, yMin);
+	profile(columnP, v.x, xSD, xFirst, (hot ? xCMax : min(xCMax, xMax)) - xFirst + 1, xFrom, curGran, stamps);
+	profile(rowP, v.y, ySD, yFirst, (hot ? yCMax : min(yCMax, yMax)) - yFirst + 1, yFrom, curGran, stamps);
+
+	//As replayProfiles, the largest cell probability is the product of the largest column and row probabilities.
+	if (hot && fusion != FUSE_LOG_ODDS) hot = *max_element(columnP.begin(), columnP.end()) * *max_element(rowP.begin(), rowP.end()) > splitDeterminant;
+	return true;
+}
+
+//Sets a cell to a probability, or a code if quantized, keeping the totals.
+void Grid::putCell(int x, int y, double v) {
+	double before = at(x, y);
+	if (before == 0 && v == 0) return;
+	int n;
+	if (cellBits < 64) setCode(index(x, y), (unsigned int)v);
+	else *cellRun(x, y, n) = v;
+	double after = at(x, y);
+	cellCount += (after != 0) - (before != 0);
+	cellSum += after - before;
 }
 
 #endif
\ No newline at end of file
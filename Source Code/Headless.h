@@ -0,0 +1,150 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "Environment.h"
+#include "Robot.h"
+#include "Behaviour.h"
+#include "Scenario.h"
+#include "Snapshot.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+//Fixed timestep between turns in seconds.
+//Matches the 100 turns per second requested by the display timer.
+const double headlessStep = 0.01;
+
+//The outcome of a single test, as written to 'out.txt'.
+class Result {
+public:
+	Result() : exit(0), completeness(0), accuracy(0) {}
+	double exit, completeness, accuracy;
+};
+
+/*
+Runs a single test as fast as possible, without a display.
+Returns the time at which the robot exited, or 0 if it reached the end of the runtime.
+If given a writer, snapshots the grid every interval seconds and once more at the end.
+*/
+double headlessTest(Behaviour *b, float maxTime, SnapshotWriter *snapshots = NULL, double interval = 0) {
+	//Count the turns rather than accumulating the step, to avoid drift over long runs.
+	double runtime = 0;
+	long snapshot = 1;
+	for (long turn = 1; ; turn++) {
+		b->nextMove((float)headlessStep);
+		b->nextLidar((float)headlessStep);
+		runtime = turn * headlessStep;
+
+		bool end = runtime >= maxTime || b->stuck;
+		if (snapshots && (end || runtime >= snapshot * interval)) {
+			snapshots->write(b->grid, runtime);
+			while (runtime >= snapshot * interval) snapshot++;
+		}
+
+		if (runtime >= maxTime) return 0;
+		if (b->stuck) return runtime;
+	}
+}
+
+/*
+Runs a test with its own environment, robot and behaviour, so that it shares no state.
+Each test takes its own random stream, a long jump apart from the streams of the other tests.
+*/
+Result runTest(const Scenario &s, unsigned int seed, int test) {
+	Random random(seed);
+	for (int i = 0; i < test; i++)
+		random.longJump();
+
+	Environment e = s.environment();
+	Robot r(s.robotWidth, s.robotHeight, s.robotStart, s.moveRate, s.turnRate, s.lidarRate, s.noise, 0, 0, &e, random);
+	Behaviour b(&r, s.startGran, s.minGran, s.split, s.strategy, s.gridOptions);
+
+	//Each test snapshots to its own file, numbered from 1.
+	SnapshotWriter snapshots;
+	bool snapshotting = s.snapshotInterval > 0 && snapshots.open(s.snapshotFile + "_" + to_string(test + 1) + ".snap");
+
+	Result result;
+	result.exit = headlessTest(&b, s.runtime, snapshotting ? &snapshots : NULL, s.snapshotInterval);
+	result.completeness = b.grid.completeness();
+	result.accuracy = b.grid.accuracy();
+	return result;
+}
+
+//A single test of a scenario, which may be run by any thread.
+class Job {
+public:
+	Job(const Scenario *s, int test) : s(s), test(test) {}
+	const Scenario *s;
+	int test;
+	Result result;
+};
+
+/*
+Runs the jobs across a number of threads.
+Each thread takes the next remaining job until there are none left.
+Test n of every scenario takes the same random stream, so scenarios share random numbers.
+*/
+void runJobs(vector<Job> &jobs, unsigned int seed, int threads) {
+	atomic<int> next(0);
+	mutex printing;
+	int total = (int)jobs.size();
+
+	vector<thread> workers;
+	for (int t = 0; t < threads; t++)
+		workers.push_back(thread([&]() {
+			for (int i = next++; i < total; i = next++) {
+				{
+					lock_guard<mutex> lock(printing);
+					cout << "Test " << i + 1 << "/" << total << endl;
+				}
+				jobs[i].result = runTest(*jobs[i].s, seed, jobs[i].test);
+			}
+		}));
+	for (unsigned int t = 0; t < workers.size(); t++)
+		workers[t].join();
+}
+
+//Runs every test of the scenario, results are returned in test order.
+vector<Result> runTests(const Scenario &s, unsigned int seed, int threads) {
+	vector<Job> jobs;
+	for (int test = 0; test < s.tests; test++)
+		jobs.push_back(Job(&s, test));
+	runJobs(jobs, seed, threads);
+
+	vector<Result> results;
+	for (unsigned int i = 0; i < jobs.size(); i++)
+		results.push_back(jobs[i].result);
+	return results;
+}
+
+/*
+Runs every test for the configuration without opening a window.
+Results are appended to 'out.txt' in the same format as the display.
+*/
+void headless(const Scenario &s, string filename, unsigned int seed, int threads) {
+	//A runtime is needed for a test to end.
+	if (s.runtime <= 0) {
+		cout << "Headless mode requires a runtime." << endl;
+		return;
+	}
+
+	vector<Result> results = runTests(s, seed, threads);
+
+	fstream out("out.txt", fstream::in | fstream::out | fstream::app);
+	out << filename << endl;
+
+	//Print exit state, completeness and accuracy.
+	for (unsigned int i = 0; i < results.size(); i++) {
+		out << results[i].exit;
+		out << "\t" << results[i].completeness;
+		out << "\t" << results[i].accuracy << endl;
+	}
+
+	out.close();
+}
+
+#endif
\ No newline at end of file
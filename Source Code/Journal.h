@@ -0,0 +1,75 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <vector>
+using namespace std;
+
+class Cell {
+public:
+	Cell(int x, int y, double p) : x(x), y(y), p(p) {}
+	int x, y;
+	double p;
+};
+
+/*
+Logs the previous value of every cell changed since an epoch began, so that the changes may be rolled back.
+Epochs may be nested, with a mark where each began. Nothing is logged outside of an epoch.
+The log holds at most limit cells, reserved once when the first epoch begins, so logging never allocates.
+Beyond the limit the epochs are lost, and can no longer be rolled back.
+*/
+class Journal {
+public:
+	Journal(int limit = 0) : limit(limit), lost(false) {}
+	void begin();
+	void log(int x, int y, double p);
+	int start() const { return (lost || marks.empty()) ? -1 : marks.back(); }
+	void commit();
+	void discard();
+	void invalidate();
+	bool recording() const { return !marks.empty() && !lost; }
+	//
+	int limit;
+	bool lost;
+	vector<Cell> cells;
+	vector<int> marks;
+};
+
+//Begins an epoch.
+void Journal::begin() {
+	if ((int)cells.capacity() < limit) cells.reserve(limit);
+	marks.push_back((int)cells.size());
+}
+
+//Logs the previous value of a cell, losing the epochs if the log is full.
+void Journal::log(int x, int y, double p) {
+	if ((int)cells.size() == limit) {
+		invalidate();
+		return;
+	}
+	cells.push_back(Cell(x, y, p));
+}
+
+//Ends the latest epoch, keeping its changes.
+//Its cells stay in the log for any epoch it is nested in, once every epoch has ended the log is cleared.
+void Journal::commit() {
+	marks.pop_back();
+	if (marks.empty()) {
+		cells.clear();
+		lost = false;
+	}
+}
+
+//Ends the latest epoch once its cells, from start(), have been restored, if an epoch has begun.
+void Journal::discard() {
+	if (marks.empty()) return;
+	if (!lost) cells.erase(cells.begin() + marks.back(), cells.end());
+	commit();
+}
+
+//Loses every open epoch, when the cells they logged have been moved or cleared.
+void Journal::invalidate() {
+	cells.clear();
+	lost = !marks.empty();
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,85 @@
+#ifndef LOGODDS_H
+#define LOGODDS_H
+
+#include <vector>
+#include <cstring>
+#include <math.h>
+using namespace std;
+
+//The range of log-odds which codes cover, from a probability of about 6e-6 to 1 - 6e-6.
+const double minLogOdds = -12, maxLogOdds = 12;
+
+/*
+Cell probabilities quantized as log-odds, in codes of 8 or 16 bits.
+Code 0 is an empty cell, with probability 0, and code c > 0 has log-odds minLogOdds + c * step.
+Codes rise with probability, so the larger of two codes is the code of the larger probability.
+Adding codes adds the log-odds of independent evidence, taking minLogOdds as the prior of every cell.
+Either way codes saturate at maxCode.
+Encoding is a lookup by the exponent and leading mantissa bits of the probability as a float, rather than a log.
+*/
+class LogOdds {
+public:
+	LogOdds(int bits = 16);
+	unsigned int encode(double p) const;
+	unsigned int exact(double p) const;
+	double decode(unsigned int code) const { return probability[code]; }
+	unsigned int fuse(unsigned int a, unsigned int b, bool sum) const;
+	//
+	int bits;
+	unsigned int maxCode;
+	double step;
+	vector<double> probability;
+	//Probabilities below 2^-minExponent all take code 1.
+	//Each power of 2 above is split into 2^mantissaBits parts, so a part spans at most 2^-mantissaBits of its probability.
+	static const int minExponent = 18, mantissaBits = 12;
+	vector<unsigned short> codes;
+};
+
+LogOdds::LogOdds(int bits) {
+	this->bits = bits;
+	maxCode = (1u << bits) - 1;
+	step = (maxLogOdds - minLogOdds) / maxCode;
+
+	//Decoding is a lookup, so that cells are read as fast as doubles.
+	probability.resize(maxCode + 1);
+	probability[0] = 0;
+	for (unsigned int c = 1; c <= maxCode; c++)
+		probability[c] = 1 / (1 + exp(-(minLogOdds + c * step)));
+
+	//Each part takes the code of the probability at its middle.
+	codes.resize(minExponent << mantissaBits);
+	for (unsigned int i = 0; i < codes.size(); i++) {
+		int exponent = (int)(i >> mantissaBits) - minExponent;
+		double mantissa = 1 + ((i & ((1 << mantissaBits) - 1)) + 0.5) / (1 << mantissaBits);
+		codes[i] = (unsigned short)exact(ldexp(mantissa, exponent));
+	}
+}
+
+//The code of a probability, any probability > 0 takes at least code 1.
+unsigned int LogOdds::encode(double p) const {
+	if (p <= 0) return 0;
+	float f = (float)p;
+	if (f >= 1) return maxCode;
+	unsigned int fBits;
+	memcpy(&fBits, &f, sizeof(fBits));
+	int i = (int)(fBits >> (23 - mantissaBits)) - ((127 - minExponent) << mantissaBits);
+	return (i < 0) ? 1 : codes[i];
+}
+
+//The code of a probability, rounded to the nearest code, any probability > 0 takes at least code 1.
+unsigned int LogOdds::exact(double p) const {
+	if (p <= 0) return 0;
+	if (p >= 1) return maxCode;
+	double c = floor((log(p / (1 - p)) - minLogOdds) / step + 0.5);
+	if (c < 1) return 1;
+	if (c > maxCode) return maxCode;
+	return (unsigned int)c;
+}
+
+//Fuses two codes by their maximum, or by adding their evidence.
+unsigned int LogOdds::fuse(unsigned int a, unsigned int b, bool sum) const {
+	if (!sum) return (a > b) ? a : b;
+	return (a + b > maxCode) ? maxCode : a + b;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,124 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+/*
+A level of the pyramid, each cell covering 2^level by 2^level cells of the grid.
+Cells are stored row by row from xFrom, yFrom, in cells of the level from the world origin.
+maxP, sum: the largest probability of the cells covered, and the sum of their probabilities.
+*/
+class PyramidLevel {
+public:
+	PyramidLevel() : xFrom(0), yFrom(0), width(0), height(0) {}
+	int index(int x, int y) const { return (y - yFrom) * width + x - xFrom; }
+	bool contains(int x, int y) const { return x >= xFrom && y >= yFrom && x < xFrom + width && y < yFrom + height; }
+	int xFrom, yFrom, width, height;
+	vector<double> maxP, sum;
+};
+
+/*
+Coarser copies of the grid, each level halving the one below, up to a level of at most two cells each way.
+Each cell keeps the maximum and the mean of the cells of the grid it covers, so coarse readers need not visit every cell.
+Levels are addressed by cells from the world origin, so they keep their cells as the grid grows.
+Level l is kept in levels[l - 1], the grid itself is level 0.
+*/
+class Pyramid {
+public:
+	Pyramid() : enabled(false), stale(false), gran(0), xFrom(0), yFrom(0), width(0), height(0) {}
+	static int down(int c, int level) { return (c >= 0) ? c >> level : -((-c + (1 << level) - 1) >> level); }
+	int top() const { return (int)levels.size(); }
+	int layout(int xFrom, int yFrom, int width, int height, bool keep);
+	void touch(int xMin, int yMin, int xMax, int yMax);
+	void combine(int level, int xMin, int yMin, int xMax, int yMax);
+	double maxAt(int level, int x, int y) const;
+	double meanAt(int level, int x, int y) const;
+	//
+	bool enabled;
+	//Set when the levels must be found again from the grid before they are next read.
+	bool stale;
+	//The granularity and extent of the grid, in cells from the world origin, when the levels were last found.
+	double gran;
+	int xFrom, yFrom, width, height;
+	vector<PyramidLevel> levels;
+	//The boxes of cells mapped since the levels were last read, four coords to a box.
+	vector<int> dirty;
+};
+
+/*
+Lays the levels out over the given extent of the grid, keeping the cells of any level already covering part of it.
+Returns the first level with no cells kept, which must be found in full, or 0 if every level was kept.
+*/
+int Pyramid::layout(int xFrom, int yFrom, int width, int height, bool keep) {
+	this->xFrom = xFrom; this->yFrom = yFrom;
+	this->width = width; this->height = height;
+	int count = 1;
+	while (down(xFrom + width - 1, count) - down(xFrom, count) > 1 || down(yFrom + height - 1, count) - down(yFrom, count) > 1)
+		count++;
+
+	vector<PyramidLevel> newLevels(count);
+	for (int l = 1; l <= count; l++) {
+		PyramidLevel &n = newLevels[l - 1];
+		n.xFrom = down(xFrom, l); n.yFrom = down(yFrom, l);
+		n.width = down(xFrom + width - 1, l) - n.xFrom + 1;
+		n.height = down(yFrom + height - 1, l) - n.yFrom + 1;
+		n.maxP.assign(n.width * n.height, 0);
+		n.sum.assign(n.width * n.height, 0);
+		if (!keep || l > top()) continue;
+
+		const PyramidLevel &o = levels[l - 1];
+		int xMin = max(o.xFrom, n.xFrom), xMax = min(o.xFrom + o.width, n.xFrom + n.width);
+		int yMin = max(o.yFrom, n.yFrom), yMax = min(o.yFrom + o.height, n.yFrom + n.height);
+		for (int y = yMin; y < yMax; y++)
+			for (int x = xMin; x < xMax; x++) {
+				n.maxP[n.index(x, y)] = o.maxP[o.index(x, y)];
+				n.sum[n.index(x, y)] = o.sum[o.index(x, y)];
+			}
+	}
+	int first = keep ? top() + 1 : 1;
+	levels.swap(newLevels);
+	return (first <= top()) ? first : 0;
+}
+
+//Notes a box of cells which has been mapped, so that the levels above it are found again when next read.
+void Pyramid::touch(int xMin, int yMin, int xMax, int yMax) {
+	dirty.push_back(xMin); dirty.push_back(yMin);
+	dirty.push_back(xMax); dirty.push_back(yMax);
+}
+
+//Finds the cells of a level, above level 1, covering the given cells of the grid, from the four cells below each.
+void Pyramid::combine(int level, int xMin, int yMin, int xMax, int yMax) {
+	PyramidLevel &l = levels[level - 1];
+	const PyramidLevel &below = levels[level - 2];
+	int xCMin = max(down(xMin, level), l.xFrom), xCMax = min(down(xMax, level), l.xFrom + l.width - 1);
+	int yCMin = max(down(yMin, level), l.yFrom), yCMax = min(down(yMax, level), l.yFrom + l.height - 1);
+	for (int y = yCMin; y <= yCMax; y++)
+		for (int x = xCMin; x <= xCMax; x++) {
+			double m = 0, s = 0;
+			for (int dy = 0; dy < 2; dy++)
+				for (int dx = 0; dx < 2; dx++)
+					if (below.contains(2 * x + dx, 2 * y + dy)) {
+						int i = below.index(2 * x + dx, 2 * y + dy);
+						m = max(m, below.maxP[i]);
+						s += below.sum[i];
+					}
+			l.maxP[l.index(x, y)] = m;
+			l.sum[l.index(x, y)] = s;
+		}
+}
+
+//The largest probability of the cells covered by cell x, y of a level, 0 beyond the grid.
+double Pyramid::maxAt(int level, int x, int y) const {
+	const PyramidLevel &l = levels[level - 1];
+	return l.contains(x, y) ? l.maxP[l.index(x, y)] : 0;
+}
+
+//The mean probability of the cells covered by cell x, y of a level, counting those beyond the grid as empty.
+double Pyramid::meanAt(int level, int x, int y) const {
+	const PyramidLevel &l = levels[level - 1];
+	return l.contains(x, y) ? l.sum[l.index(x, y)] / (1 << (2 * level)) : 0;
+}
+
+#endif
\ No newline at end of file
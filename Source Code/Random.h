@@ -0,0 +1,185 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <math.h>
+#include <stdlib.h>
+
+/*
+A stream of random numbers owned by a single robot or behaviour.
+Replaces the global rand(), so that tests may run in parallel.
+Uses xoshiro256**, which can be split into non-overlapping streams by jumping ahead.
+*/
+class Random {
+public:
+	Random(unsigned int seed = 0) { this->seed(seed); }
+	void seed(unsigned int seed);
+	unsigned long long next();
+	void jump();
+	void longJump();
+	Random split();
+	double uniform();
+	int below(int n);
+	double normal();
+	void normals(float *out, int n);
+private:
+	unsigned long long s[4];
+	static unsigned long long rotl(unsigned long long x, int k) { return (x << k) | (x >> (64 - k)); }
+	void jump(const unsigned long long *polynomial);
+	double normalTail(int hz, int iz);
+};
+
+//Spreads the seed over the whole state with splitmix64, so that close seeds give unrelated streams.
+void Random::seed(unsigned int seed) {
+	unsigned long long x = seed;
+	for (int i = 0; i < 4; i++) {
+		unsigned long long z = (x += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		s[i] = z ^ (z >> 31);
+	}
+}
+
+//Returns the next 64 random bits.
+unsigned long long Random::next() {
+	unsigned long long result = rotl(s[1] * 5, 7) * 9;
+	unsigned long long t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return result;
+}
+
+//Advances the stream by the given jump polynomial.
+void Random::jump(const unsigned long long *polynomial) {
+	unsigned long long t[4] = {0, 0, 0, 0};
+	for (int i = 0; i < 4; i++)
+		for (int b = 0; b < 64; b++) {
+			if (polynomial[i] & (1ULL << b))
+				for (int j = 0; j < 4; j++)
+					t[j] ^= s[j];
+			next();
+		}
+	for (int j = 0; j < 4; j++)
+		s[j] = t[j];
+}
+
+//Advances the stream by 2^128 numbers.
+void Random::jump() {
+	static const unsigned long long polynomial[] = {
+		0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL};
+	jump(polynomial);
+}
+
+//Advances the stream by 2^192 numbers, giving room for 2^64 splits in between.
+void Random::longJump() {
+	static const unsigned long long polynomial[] = {
+		0x76E15D3EFEFDCBBFULL, 0xC5004E441C522FB3ULL, 0x77710069854EE241ULL, 0x39109BB02ACBE635ULL};
+	jump(polynomial);
+}
+
+//Returns a stream that will not overlap this one, which jumps past it.
+Random Random::split() {
+	Random child = *this;
+	jump();
+	return child;
+}
+
+//Returns a uniform random number between 0 and 1, excluding both.
+double Random::uniform() {
+	return ((next() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+//Returns a uniform random integer between 0 and n - 1.
+int Random::below(int n) {
+	return (int)(((next() >> 32) * (unsigned long long)n) >> 32);
+}
+
+/*
+Tables for the ziggurat method of Marsaglia and Tsang, with 128 layers.
+k: integer thresholds for accepting within a layer, w: layer widths, f: density at each layer.
+Built once and only read afterwards, so they may be shared between threads.
+*/
+class Ziggurat {
+public:
+	Ziggurat();
+	unsigned int k[128];
+	double w[128], f[128];
+};
+
+Ziggurat::Ziggurat() {
+	const double m = 2147483648.0;
+	const double v = 9.91256303526217e-3;
+	double d = 3.442619855899, t = d;
+	double q = v / exp(-0.5 * d * d);
+
+	k[0] = (unsigned int)((d / q) * m);
+	k[1] = 0;
+	w[0] = q / m;
+	w[127] = d / m;
+	f[0] = 1;
+	f[127] = exp(-0.5 * d * d);
+
+	for (int i = 126; i >= 1; i--) {
+		d = sqrt(-2 * log(v / d + exp(-0.5 * d * d)));
+		k[i + 1] = (unsigned int)((d / t) * m);
+		t = d;
+		f[i] = exp(-0.5 * d * d);
+		w[i] = d / m;
+	}
+}
+
+const Ziggurat &ziggurat() {
+	static const Ziggurat z;
+	return z;
+}
+
+//Returns a standard normal random number using the ziggurat method.
+double Random::normal() {
+	const Ziggurat &z = ziggurat();
+	int hz = (int)(next() >> 32);
+	int iz = hz & 127;
+
+	//Most numbers fall inside a layer, which needs no transcendental functions.
+	if ((unsigned long long)llabs(hz) < z.k[iz]) return hz * z.w[iz];
+	return normalTail(hz, iz);
+}
+
+//Handles the numbers which fall on the edge of a layer, or in the tail.
+double Random::normalTail(int hz, int iz) {
+	const Ziggurat &z = ziggurat();
+	const double r = 3.442620;
+
+	while (true) {
+		double x = hz * z.w[iz];
+
+		//Sample from the tail.
+		if (iz == 0) {
+			double y;
+			do {
+				x = -log(uniform()) / r;
+				y = -log(uniform());
+			}
+			while (y + y < x * x);
+			return (hz > 0) ? r + x : -r - x;
+		}
+
+		//Accept the edge of the layer under the density.
+		if (z.f[iz] + uniform() * (z.f[iz - 1] - z.f[iz]) < exp(-0.5 * x * x)) return x;
+
+		hz = (int)(next() >> 32);
+		iz = hz & 127;
+		if ((unsigned long long)llabs(hz) < z.k[iz]) return hz * z.w[iz];
+	}
+}
+
+//Fills out with n standard normal random numbers, each drawn in turn by normal().
+//This is a plain scalar loop, a batch only keeps the refills out of the caller's path, the ziggurat itself is not vectorized.
+void Random::normals(float *out, int n) {
+	for (int i = 0; i < n; i++)
+		out[i] = (float)normal();
+}
+
+#endif
\ No newline at end of file
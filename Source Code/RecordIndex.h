@@ -0,0 +1,119 @@
+#ifndef RECORDINDEX_H
+#define RECORDINDEX_H
+
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <algorithm>
+#include <math.h>
+#include "Tiles.h"
+using namespace std;
+
+/*
+A box of cells, or of tiles, by their coords from the world origin.
+*/
+class IndexBox {
+public:
+	IndexBox() : xMin(0), yMin(0), xMax(-1), yMax(-1) {}
+	IndexBox(int xMin, int yMin, int xMax, int yMax) : xMin(xMin), yMin(yMin), xMax(xMax), yMax(yMax) {}
+	bool empty() const { return xMax < xMin || yMax < yMin; }
+	bool contains(int x, int y) const { return x >= xMin && x <= xMax && y >= yMin && y <= yMax; }
+	bool operator==(const IndexBox &other) const { return xMin == other.xMin && yMin == other.yMin && xMax == other.xMax && yMax == other.yMax; }
+	IndexBox clip(const IndexBox &other) const { return IndexBox(max(xMin, other.xMin), max(yMin, other.yMin), min(xMax, other.xMax), min(yMax, other.yMax)); }
+	IndexBox join(const IndexBox &other) const;
+	IndexBox tiles() const { return IndexBox(Tiles::tile(xMin), Tiles::tile(yMin), Tiles::tile(xMax), Tiles::tile(yMax)); }
+	static IndexBox tile(int tx, int ty) { return IndexBox(tx * Tiles::tileCells, ty * Tiles::tileCells, (tx + 1) * Tiles::tileCells - 1, (ty + 1) * Tiles::tileCells - 1); }
+	int xMin, yMin, xMax, yMax;
+};
+
+//The smallest box holding both boxes, either of which may be empty.
+IndexBox IndexBox::join(const IndexBox &other) const {
+	if (empty()) return other;
+	if (other.empty()) return *this;
+	return IndexBox(min(xMin, other.xMin), min(yMin, other.yMin), max(xMax, other.xMax), max(yMax, other.yMax));
+}
+
+/*
+The hit of a record and its variances, as it was last mapped.
+*/
+class IndexedHit {
+public:
+	IndexedHit() : x(0), y(0), xV(0), yV(0) {}
+	IndexedHit(float x, float y, float xV, float yV) : x(x), y(y), xV(xV), yV(yV) {}
+	float x, y, xV, yV;
+};
+
+/*
+The records whose 3 sd box covers each tile of the grid, in tiles of 32 by 32 cells at the current granularity, like the tiles of a sparse grid.
+When a kalman update moves a record, the cells its old hit may hold the value of are dirtied, and they are rebuilt from the records now covering them.
+So the old contribution of a corrected record leaves the grid, without remapping every record, or even every cell of a tile.
+A record is listed by a tile at most once, but may still be listed by a tile its box has since left, until that tile is rebuilt.
+The index is of the poses records had as they were last mapped, so it is found again from every record whenever the granularity changes or records are dropped.
+*/
+class RecordIndex {
+public:
+	static const int tileCells = Tiles::tileCells;
+	RecordIndex() : enabled(false), gran(0), generation(0) {}
+	static IndexBox box(double x, double y, double xV, double yV, double gran);
+	void add(unsigned int i, const IndexBox &b, const IndexedHit &h);
+	void move(unsigned int i, const IndexBox &b, const IndexedHit &h, const IndexBox &held);
+	void clear();
+	//
+	bool enabled;
+	//The granularity and the generation of the record store the index was found for.
+	double gran;
+	unsigned int generation;
+	//The records listed by each tile, and the box of cells and hit of each record, by record.
+	unordered_map<unsigned long long, vector<unsigned int> > tiles;
+	vector<IndexBox> boxes;
+	vector<IndexedHit> hits;
+	//The cells to be rebuilt within each tile, by key, in order so that tiles are rebuilt the same way every time.
+	map<unsigned long long, IndexBox> dirty;
+};
+
+//The cells within 3 sd of a point, mapped onto cells of the given granularity.
+//As for the grid, the cells run from the first grid line at or beyond mean - 3 sd to that at or beyond mean + 3 sd.
+IndexBox RecordIndex::box(double x, double y, double xV, double yV, double gran) {
+	double xSD = sqrt(xV), ySD = sqrt(yV);
+	return IndexBox((int)ceil((x - 3 * xSD) / gran - 0.000000001), (int)ceil((y - 3 * ySD) / gran - 0.000000001),
+		(int)ceil((x + 3 * xSD) / gran - 0.000000001), (int)ceil((y + 3 * ySD) / gran - 0.000000001));
+}
+
+//Lists a record by the tiles of its box.
+void RecordIndex::add(unsigned int i, const IndexBox &b, const IndexedHit &h) {
+	if (boxes.size() <= i) {
+		boxes.resize(i + 1);
+		hits.resize(i + 1);
+	}
+	boxes[i] = b;
+	hits[i] = h;
+	IndexBox t = b.tiles();
+	for (int ty = t.yMin; ty <= t.yMax; ty++)
+		for (int tx = t.xMin; tx <= t.xMax; tx++)
+			tiles[Tiles::key(tx, ty)].push_back(i);
+}
+
+//Moves a record to a new box and hit, dirtying the cells its old hit held, and listing it by the tiles it had not covered.
+void RecordIndex::move(unsigned int i, const IndexBox &b, const IndexedHit &h, const IndexBox &held) {
+	IndexBox &old = boxes[i];
+	IndexBox from = old.tiles(), to = b.tiles(), cleared = held.tiles();
+	for (int ty = cleared.yMin; ty <= cleared.yMax && !held.empty(); ty++)
+		for (int tx = cleared.xMin; tx <= cleared.xMax; tx++) {
+			IndexBox &cells = dirty[Tiles::key(tx, ty)];
+			cells = cells.join(held.clip(IndexBox::tile(tx, ty)));
+		}
+	for (int ty = to.yMin; ty <= to.yMax; ty++)
+		for (int tx = to.xMin; tx <= to.xMax; tx++)
+			if (!from.contains(tx, ty)) tiles[Tiles::key(tx, ty)].push_back(i);
+	old = b;
+	hits[i] = h;
+}
+
+void RecordIndex::clear() {
+	tiles.clear();
+	boxes.clear();
+	hits.clear();
+	dirty.clear();
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,144 @@
+#ifndef RECORDSTORE_H
+#define RECORDSTORE_H
+
+#include <deque>
+#include <vector>
+#include <math.h>
+#include "Vertex.h"
+#include "Record.h"
+using namespace std;
+
+/*
+A chunk of records, each field in its own array.
+endX, endY: where the lidar hit, in the world, found from the pose while fresh is set.
+*/
+class RecordChunk {
+public:
+	static const int chunkRecords = 4096;
+	float x[chunkRecords], y[chunkRecords], b[chunkRecords], l[chunkRecords], d[chunkRecords], xV[chunkRecords], yV[chunkRecords];
+	float endX[chunkRecords], endY[chunkRecords];
+	bool fresh[chunkRecords];
+};
+
+/*
+The records of a run, stored field by field in chunks, so that adding a record never moves the records before it.
+Each record keeps where its lidar hit, found once rather than on every replay, and found again only once its pose is changed.
+Records are read by index, or a chunk at a time, after refresh(), to stream their hits and variances.
+*/
+class RecordStore {
+public:
+	static const int chunkRecords = RecordChunk::chunkRecords;
+	//The bytes each record takes in its chunk.
+	static const int recordBytes = 9 * sizeof(float) + sizeof(bool);
+	RecordStore() : count(0), generation(0) {}
+	static Vertex hit(float x, float y, float l, float d);
+	unsigned int size() const { return count; }
+	bool empty() const { return count == 0; }
+	void push_back(const Record &r);
+	void clear();
+	Record operator[](unsigned int i) const;
+	Record back() const { return (*this)[count - 1]; }
+	float x(unsigned int i) const { return chunks[i / chunkRecords].x[i % chunkRecords]; }
+	float y(unsigned int i) const { return chunks[i / chunkRecords].y[i % chunkRecords]; }
+	float b(unsigned int i) const { return chunks[i / chunkRecords].b[i % chunkRecords]; }
+	float xV(unsigned int i) const { return chunks[i / chunkRecords].xV[i % chunkRecords]; }
+	float yV(unsigned int i) const { return chunks[i / chunkRecords].yV[i % chunkRecords]; }
+	void setPose(unsigned int i, float x, float y, float xV, float yV);
+	Vertex endpoint(unsigned int i);
+	void refresh();
+	void retain(const vector<unsigned int> &kept);
+	int chunkSize(unsigned int c) const { return (c + 1 < chunks.size()) ? chunkRecords : count - c * chunkRecords; }
+	//
+	deque<RecordChunk> chunks;
+	unsigned int count;
+	//Records whose pose has changed since their hit was last found.
+	vector<unsigned int> stale;
+	//Counts the times records were dropped, so that whatever keeps records by index knows to find them again.
+	unsigned int generation;
+};
+
+//Where the lidar hit, from the pose of the robot, the lidar angle and the distance read.
+Vertex RecordStore::hit(float x, float y, float l, float d) {
+	float radians = l * (float)PI / 180;
+	float vX = x + d * cos(radians);
+	float vY = y + d * sin(radians);
+	return Vertex(vX, vY);
+}
+
+//Adds a record, finding its hit.
+void RecordStore::push_back(const Record &r) {
+	if (count % chunkRecords == 0) chunks.resize(chunks.size() + 1);
+	RecordChunk &c = chunks.back();
+	int i = count % chunkRecords;
+	c.x[i] = r.x; c.y[i] = r.y; c.b[i] = r.b; c.l[i] = r.l; c.d[i] = r.d;
+	c.xV[i] = r.xV; c.yV[i] = r.yV;
+	Vertex v = hit(r.x, r.y, r.l, r.d);
+	c.endX[i] = v.x; c.endY[i] = v.y;
+	c.fresh[i] = true;
+	count++;
+}
+
+void RecordStore::clear() {
+	chunks.clear();
+	stale.clear();
+	count = 0;
+	generation++;
+}
+
+//A copy of a record, gathered from its fields.
+Record RecordStore::operator[](unsigned int i) const {
+	const RecordChunk &c = chunks[i / chunkRecords];
+	int j = i % chunkRecords;
+	return Record(c.x[j], c.y[j], c.b[j], c.l[j], c.d[j], c.xV[j], c.yV[j]);
+}
+
+//Changes the pose of a record and its variance, its hit is found again when next read if the pose moved.
+void RecordStore::setPose(unsigned int i, float x, float y, float xV, float yV) {
+	RecordChunk &c = chunks[i / chunkRecords];
+	int j = i % chunkRecords;
+	if ((c.x[j] != x || c.y[j] != y) && c.fresh[j]) {
+		c.fresh[j] = false;
+		stale.push_back(i);
+	}
+	c.x[j] = x; c.y[j] = y;
+	c.xV[j] = xV; c.yV[j] = yV;
+}
+
+//Where the lidar of a record hit, found again first if its pose has changed.
+Vertex RecordStore::endpoint(unsigned int i) {
+	RecordChunk &c = chunks[i / chunkRecords];
+	int j = i % chunkRecords;
+	if (!c.fresh[j]) {
+		Vertex v = hit(c.x[j], c.y[j], c.l[j], c.d[j]);
+		c.endX[j] = v.x; c.endY[j] = v.y;
+		c.fresh[j] = true;
+	}
+	return Vertex(c.endX[j], c.endY[j]);
+}
+
+//Finds the hit of every record whose pose has changed, so that the chunks may be read directly.
+void RecordStore::refresh() {
+	for (unsigned int i = 0; i < stale.size(); i++) endpoint(stale[i]);
+	stale.clear();
+}
+
+//Keeps only the records at the given indices, in ascending order, moving each down over those dropped.
+void RecordStore::retain(const vector<unsigned int> &kept) {
+	refresh();
+	for (unsigned int j = 0; j < kept.size(); j++) {
+		unsigned int i = kept[j];
+		if (i == j) continue;
+		const RecordChunk &from = chunks[i / chunkRecords];
+		RecordChunk &to = chunks[j / chunkRecords];
+		int a = i % chunkRecords, b = j % chunkRecords;
+		to.x[b] = from.x[a]; to.y[b] = from.y[a]; to.b[b] = from.b[a]; to.l[b] = from.l[a]; to.d[b] = from.d[a];
+		to.xV[b] = from.xV[a]; to.yV[b] = from.yV[a];
+		to.endX[b] = from.endX[a]; to.endY[b] = from.endY[a];
+		to.fresh[b] = from.fresh[a];
+	}
+	count = kept.size();
+	chunks.resize((count + chunkRecords - 1) / chunkRecords);
+	generation++;
+}
+
+#endif
\ No newline at end of file
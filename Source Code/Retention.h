@@ -0,0 +1,289 @@
+#ifndef RETENTION_H
+#define RETENTION_H
+
+#include <vector>
+#include <iostream>
+#include <unordered_map>
+#include <algorithm>
+#include <math.h>
+#include "RecordStore.h"
+#include "Grid.h"
+using namespace std;
+
+/*
+The probabilities a record gives the columns and rows of cells within 3 sd of its hit, at one granularity.
+*/
+class Footprint {
+public:
+	Footprint() : xFirst(0), yFirst(0) {}
+	double at(int x, int y) const {
+		int i = x - xFirst, j = y - yFirst;
+		return (i >= 0 && j >= 0 && i < (int)columnP.size() && j < (int)rowP.size()) ? columnP[i] * rowP[j] : 0;
+	}
+	int xFirst, yFirst;
+	vector<double> columnP, rowP;
+};
+
+/*
+Bounds the records kept of a run, so that memory and the time to remap stay bounded however long it runs.
+Only records before the last with zero variance are settled, as a kalman update never reaches back past it.
+A settled record is dropped if it could raise no cell by more than tolerance, at every granularity the grid may map at, from the start granularity down to the minimum:
+either no cell it covers takes more than tolerance, or kept records with their hits in the same cell of the minimum granularity cover each of its cells to within tolerance.
+While the grid may still split, a cell the record takes above the split determinant must be covered exactly, so dropping it cannot move where the grid splits.
+A record covering a kept record of its cell exactly takes its place, so that dropped records stay within tolerance of those kept.
+Cells are from the world origin, so records are merged the same however the grid grows.
+Should more than budget records remain, the records with their hits in each cell are merged into the one of least variance, the cells doubling until within budget.
+Such merges may stray beyond the tolerance, so they are counted in forced, and reached is raised by the most any merge of a round leaves a cell short.
+The kept records are then within reached of every record, as each record is merged at most once a round.
+The cells stop doubling once they span the world, but records are still merged within them, so decimating only ends over budget when the records yet to settle, which cannot be merged, leave no room.
+That is counted in overBudget, and told once.
+The footprints of kept records are cached, within the memory the budget leaves over from the records, or freely without a budget, and found again when not.
+Dropped records are only taken out of the store once they number half those kept, or the store is over budget, so that records move rarely.
+*/
+class Retention {
+public:
+	Retention() : enabled(false), budget(0), tolerance(0), reached(0), cell(0), determinant(0), settled(0), kept(0), forced(0), overBudget(0), cacheBytes(0) {}
+	Retention(int budget, double tolerance);
+	unsigned int decimate(RecordStore &data, unsigned int end, Grid &grid);
+	void consider(RecordStore &data, unsigned int i, Grid &grid);
+	void merge(RecordStore &data, unsigned int end, Grid &grid);
+	bool covers(const vector<Footprint> &k, const vector<Footprint> &i, double within) const;
+	double shortfall(const vector<Footprint> &k, const vector<Footprint> &i) const;
+	const vector<Footprint> &footprint(RecordStore &data, unsigned int i, Grid &grid);
+	void forget(unsigned int i);
+	static size_t bytes(const vector<Footprint> &f);
+	static void span(double mean, double sd, double gran, int &first, int &n);
+	static unsigned long long key(Vertex v, double size);
+	//
+	bool enabled;
+	int budget;
+	double tolerance;
+	//The tolerance the kept records are within of every record, which forced merges raise.
+	double reached;
+	//The size of the cells records are merged within to keep to the budget, which only grows.
+	double cell;
+	//The granularities the grid may map at, coarsest first, and the determinant it splits above while coarser than the last.
+	vector<double> grans;
+	double determinant;
+	//The records before settled have been decimated, the rest are yet to be, and kept of them are kept.
+	unsigned int settled, kept;
+	int forced, overBudget;
+	//The kept settled records with their hits in each cell of the minimum granularity, and whether each settled record is kept.
+	unordered_map<unsigned long long, vector<unsigned int> > cells;
+	vector<bool> keep;
+	//The footprints of kept records at each granularity, and the bytes they take.
+	unordered_map<unsigned int, vector<Footprint> > footprints;
+	size_t cacheBytes;
+	//A footprint found but not cached, and one with no cells, which covers nothing.
+	vector<Footprint> found, nothing;
+	StampCache exact;
+};
+
+Retention::Retention(int budget, double tolerance) {
+	enabled = true;
+	this->budget = budget;
+	this->tolerance = tolerance;
+	reached = tolerance;
+	cell = 0;
+	determinant = 0;
+	settled = 0; kept = 0;
+	forced = 0;
+	overBudget = 0;
+	cacheBytes = 0;
+}
+
+//The cells, of the given granularity from the world origin, a point within 3 sd is mapped onto.
+//As for the grid, these run from the cell after the first grid line at or beyond mean - 3 sd, to that after mean + 3 sd.
+void Retention::span(double mean, double sd, double gran, int &first, int &n) {
+	first = (int)ceil((mean - 3 * sd) / gran - 0.000000001);
+	n = (int)ceil((mean + 3 * sd) / gran - 0.000000001) - first + 1;
+}
+
+//The key of the cell of the given size a hit is in.
+unsigned long long Retention::key(Vertex v, double size) {
+	return Tiles::key((int)floor(v.x / size), (int)floor(v.y / size));
+}
+
+//Roughly the bytes the footprints of a record take.
+size_t Retention::bytes(const vector<Footprint> &f) {
+	size_t n = sizeof(f) + f.size() * sizeof(Footprint);
+	for (unsigned int l = 0; l < f.size(); l++) n += (f[l].columnP.size() + f[l].rowP.size()) * sizeof(double);
+	return n;
+}
+
+/*
+The footprints of a record at each granularity, from the cache or found again.
+One found is cached if there is no budget, or the records and cache stay within the memory of budget records, otherwise it is only valid until the next is found.
+*/
+const vector<Footprint> &Retention::footprint(RecordStore &data, unsigned int i, Grid &grid) {
+	unordered_map<unsigned int, vector<Footprint> >::iterator c = footprints.find(i);
+	if (c != footprints.end()) return c->second;
+
+	Vertex v = data.endpoint(i);
+	double xSD = sqrt(data.xV(i)), ySD = sqrt(data.yV(i));
+	found.resize(grans.size());
+	for (unsigned int l = 0; l < grans.size(); l++) {
+		Footprint &f = found[l];
+		int columns, rows;
+		span(v.x, xSD, grans[l], f.xFirst, columns);
+		span(v.y, ySD, grans[l], f.yFirst, rows);
+		grid.profile(f.columnP, v.x, xSD, f.xFirst, columns, 0, grans[l], exact);
+		grid.profile(f.rowP, v.y, ySD, f.yFirst, rows, 0, grans[l], exact);
+	}
+
+	size_t n = bytes(found);
+	if (budget > 0 && (size_t)data.size() * RecordStore::recordBytes + cacheBytes + n > (size_t)budget * RecordStore::recordBytes) return found;
+	cacheBytes += n;
+	return footprints[i] = found;
+}
+
+//Drops the cached footprints of a record.
+void Retention::forget(unsigned int i) {
+	unordered_map<unsigned int, vector<Footprint> >::iterator c = footprints.find(i);
+	if (c == footprints.end()) return;
+	cacheBytes -= bytes(c->second);
+	footprints.erase(c);
+}
+
+/*
+Tests if footprints k give every cell of footprints i at least its probability, less within, at every granularity.
+While the grid may still split, cells i takes above the determinant must be given at least their probability.
+*/
+bool Retention::covers(const vector<Footprint> &k, const vector<Footprint> &i, double within) const {
+	for (unsigned int l = 0; l < i.size(); l++) {
+		const Footprint &a = i[l], &b = k[l];
+		bool splits = l + 1 < i.size();
+		for (unsigned int y = 0; y < a.rowP.size(); y++)
+			for (unsigned int x = 0; x < a.columnP.size(); x++) {
+				double p = a.columnP[x] * a.rowP[y], q = b.at(a.xFirst + x, a.yFirst + y);
+				if (p > q + within || (splits && p > determinant && p > q)) return false;
+			}
+	}
+	return true;
+}
+
+//The most footprints k fall short of any cell of footprints i, at any granularity.
+double Retention::shortfall(const vector<Footprint> &k, const vector<Footprint> &i) const {
+	double most = 0;
+	for (unsigned int l = 0; l < i.size(); l++) {
+		const Footprint &a = i[l], &b = k[l];
+		for (unsigned int y = 0; y < a.rowP.size(); y++)
+			for (unsigned int x = 0; x < a.columnP.size(); x++)
+				most = max(most, a.columnP[x] * a.rowP[y] - b.at(a.xFirst + x, a.yFirst + y));
+	}
+	return most;
+}
+
+//Keeps or drops a newly settled record, against the kept records of its cell.
+void Retention::consider(RecordStore &data, unsigned int i, Grid &grid) {
+	//A copy, as finding the footprints of others may overwrite those found.
+	vector<Footprint> f = footprint(data, i, grid);
+	if (covers(nothing, f, tolerance)) {
+		keep[i] = false;
+		forget(i);
+		return;
+	}
+
+	//It is dropped before it replaces any, as a record it replaced would then be within tolerance only of one within tolerance of it.
+	vector<unsigned int> &others = cells[key(data.endpoint(i), grid.minGran)];
+	for (unsigned int j = 0; j < others.size(); j++)
+		if (covers(footprint(data, others[j], grid), f, tolerance)) {
+			keep[i] = false;
+			forget(i);
+			return;
+		}
+	for (unsigned int j = 0; j < others.size(); ) {
+		if (covers(f, footprint(data, others[j], grid), 0)) {
+			keep[others[j]] = false;
+			forget(others[j]);
+			others.erase(others.begin() + j);
+			kept--;
+		}
+		else j++;
+	}
+	others.push_back(i);
+	kept++;
+}
+
+//Merges the kept settled records of each cell into the one of least variance, raising reached by the most any falls short of one it replaces.
+void Retention::merge(RecordStore &data, unsigned int end, Grid &grid) {
+	unordered_map<unsigned long long, unsigned int> least;
+	for (unsigned int i = 0; i < end; i++) {
+		if (!keep[i]) continue;
+		pair<unordered_map<unsigned long long, unsigned int>::iterator, bool> found = least.insert(make_pair(key(data.endpoint(i), cell), i));
+		unsigned int &best = found.first->second;
+		if (data.xV(i) + data.yV(i) < data.xV(best) + data.yV(best)) best = i;
+	}
+
+	double worst = 0;
+	for (unsigned int i = 0; i < end; i++) {
+		if (!keep[i]) continue;
+		unsigned int best = least[key(data.endpoint(i), cell)];
+		if (best == i) continue;
+
+		//A copy, as finding the footprints of the other may overwrite those found.
+		vector<Footprint> f = footprint(data, i, grid);
+		worst = max(worst, shortfall(footprint(data, best, grid), f));
+		keep[i] = false;
+		forget(i);
+		kept--;
+		forced++;
+	}
+	reached = min(reached + worst, 1.0);
+}
+
+/*
+Decimates the records settled since last time, those before end, then drops the records not kept if it is time to.
+Returns the number of records dropped, all of which were before end.
+*/
+unsigned int Retention::decimate(RecordStore &data, unsigned int end, Grid &grid) {
+	if (grans.empty()) {
+		for (double g = grid.startGran; g > grid.minGran; g /= 2) grans.push_back(g);
+		grans.push_back(grid.minGran);
+		determinant = grid.splitDeterminant;
+		nothing.assign(grans.size(), Footprint());
+		cell = grid.minGran;
+	}
+
+	//The records have grown since the footprints were cached, so the cache gives way to them.
+	if (budget > 0 && (size_t)data.size() * RecordStore::recordBytes + cacheBytes > (size_t)budget * RecordStore::recordBytes) {
+		footprints.clear();
+		cacheBytes = 0;
+	}
+
+	keep.resize(end, true);
+	for (; settled < end; settled++) consider(data, settled, grid);
+
+	//Merge within ever larger cells until within budget, so long as cells span less than the world, and within the largest once they do.
+	unsigned int unsettled = data.size() - end;
+	while (budget > 0 && kept + unsettled > (unsigned int)budget) {
+		merge(data, end, grid);
+		if (kept + unsettled <= (unsigned int)budget || cell >= 1048576 * grid.minGran) break;
+		cell *= 2;
+	}
+	if (budget > 0 && kept + unsettled > (unsigned int)budget && overBudget++ == 0)
+		cout << "Record budget of " << budget << " cannot be met, keeping " << kept << " settled records and " << unsettled << " yet to settle." << endl;
+
+	unsigned int dropped = end - kept;
+	if (dropped == 0 || (2 * dropped < kept && (budget == 0 || data.size() <= (unsigned int)budget))) return 0;
+	vector<unsigned int> indices;
+	for (unsigned int i = 0; i < end; i++)
+		if (keep[i]) indices.push_back(i);
+	for (unsigned int i = end; i < data.size(); i++) indices.push_back(i);
+
+	//The kept records move down, so their cells are found again, and their footprints moved with them.
+	data.retain(indices);
+	unordered_map<unsigned int, vector<Footprint> > moved;
+	for (unsigned int i = 0; i < kept; i++) {
+		unordered_map<unsigned int, vector<Footprint> >::iterator c = footprints.find(indices[i]);
+		if (c != footprints.end()) moved[i].swap(c->second);
+	}
+	footprints.swap(moved);
+	settled = kept;
+	keep.assign(settled, true);
+	cells.clear();
+	for (unsigned int i = 0; i < settled; i++) cells[key(data.endpoint(i), grid.minGran)].push_back(i);
+	return dropped;
+}
+
+#endif
\ No newline at end of file
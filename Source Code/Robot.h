@@ -2,14 +2,14 @@
 #define ROBOT_H
 
 #include "Vertex.h"
+#include "Random.h"
 #include <Math.h>
 #include <list>
-#include <time.h>
 #define PI 3.14159265
 
 class Robot {
 public:
-	Robot(float width, float height, Vertex location, float moveRate, float turnRate, float lidarRate, float moveNoise, float turnNoise, float lidarNoise, Environment *e);
+	Robot(float width, float height, Vertex location, float moveRate, float turnRate, float lidarRate, float moveNoise, float turnNoise, float lidarNoise, Environment *e, Random random);
 	float width, height;
 	Vertex location;
 	float angle, lidarAngle;
@@ -34,6 +34,10 @@ public:
 	float distance(Vertex v);
 	float lidarDistance;
 	float gaussianRandom(float mean, float variance);
+	Random random;
+	static const int gaussianBatch = 64;
+	float gaussians[gaussianBatch];
+	int gaussianIndex;
 	float mNoise, tNoise, lNoise;
 	Vertex startLocation;
 	void restore();
@@ -43,8 +47,9 @@ public:
 moveRate: How many units with respect to the environment, the robot moves per second.
 turnRate: How many degrees the robot turns per second.
 lidarRate: How many degrees the lidar turns per second.
+random: The robot's own random number stream.
 */
-Robot::Robot(float width, float height, Vertex location, float moveRate, float turnRate, float lidarRate, float moveNoise, float turnNoise, float lidarNoise, Environment *e) {
+Robot::Robot(float width, float height, Vertex location, float moveRate, float turnRate, float lidarRate, float moveNoise, float turnNoise, float lidarNoise, Environment *e, Random random) {
 	this->width = width;
 	this->height = height;
 	this->startLocation = location;
@@ -59,7 +64,8 @@ Robot::Robot(float width, float height, Vertex location, float moveRate, float t
 	angle = 0;
 	lidarAngle = 0;
 	lidarDistance = (e->width > e->height) ? e->width * 2 : e->height * 2;
-	srand((int)time(NULL));
+	this->random = random;
+	gaussianIndex = gaussianBatch;
 
 	updateVertices();
 }
@@ -278,37 +284,18 @@ float Robot::distance(Vertex v) {
 	return hypotenuse;
 }
 
-//Uses the box-muller method for obtaining gaussian random numbers.
+//Returns a gaussian random number, taken from a batch generated by the ziggurat method.
 float Robot::gaussianRandom(float mean, float variance) {
 	//Efficiency improvement when there's no noise.
 	if (variance == 0) return mean;
-	
-	float sd = sqrt(variance);
-	float x1, x2, w, y1;
-	static float y2;
-	static bool set = false;
-
-	//Reuse previous y1 value (efficient).
-	if (set) {
-		y1 = y2;
-		set = false;
-	}
-	else {
-		do {
-			x1 = (float)(2.0 * rand() / RAND_MAX - 1.0);
-			x2 = (float)(2.0 * rand() / RAND_MAX - 1.0);
-			w = x1 * x1 + x2 * x2;
-		}
-		while (w >= 1.0);
 
-		w = (float)sqrt((-2.0 * log(w)) / w);
-		y1 = x1 * w;
-		y2 = x2 * w;
-		set = true;
+	//Generate the next batch once the previous one is used up.
+	if (gaussianIndex == gaussianBatch) {
+		random.normals(gaussians, gaussianBatch);
+		gaussianIndex = 0;
 	}
 
-	//box-muller equation with scalar.
-	return mean + y1 * sd;
+	return mean + gaussians[gaussianIndex++] * sqrt(variance);
 }
 
 #endif
\ No newline at end of file
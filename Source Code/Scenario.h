@@ -0,0 +1,118 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <vector>
+#include <string>
+#include "xml/pugixml.hpp"
+#include "Vertex.h"
+#include "Polygon.h"
+#include "Environment.h"
+#include "Grid.h"
+using namespace std;
+
+/*
+The settings of a configuration file, kept separately from any simulation.
+Allows each test to build its own environment, robot and behaviour.
+*/
+class Scenario {
+public:
+	Scenario() : snapshotInterval(0) {}
+	Scenario(pugi::xml_node root);
+	Environment environment() const;
+	//
+	int tests;
+	bool seeded;
+	unsigned int seed;
+	float envWidth, envHeight;
+	vector<Polygon> polygons;
+	vector<bool> beacons;
+	float robotWidth, robotHeight;
+	Vertex robotStart;
+	float moveRate, turnRate, lidarRate, noise;
+	double startGran, minGran, split;
+	GridOptions gridOptions;
+	int strategy;
+	float runtime;
+	double snapshotInterval;
+	string snapshotFile;
+};
+
+Scenario::Scenario(pugi::xml_node root) {
+	//Get the number of tests from xml, with the optional seed making them reproducible.
+	tests = atoi(root.child_value("tests"));
+	seeded = root.child("tests").attribute("seed");
+	seed = root.child("tests").attribute("seed").as_uint();
+
+	//Set up environment from xml.
+	pugi::xml_node env = root.child("environment");
+	envWidth = env.attribute("width").as_float();
+	envHeight = env.attribute("height").as_float();
+	for (pugi::xml_node polygon = env.child("polygon"); polygon; polygon = polygon.next_sibling("polygon")) {
+		Polygon p;
+		for (pugi::xml_node vertex = polygon.child("vertex"); vertex; vertex = vertex.next_sibling("vertex")) {
+			p.addVertex(Vertex(vertex.attribute("x").as_float(), vertex.attribute("y").as_float()));
+		}
+		polygons.push_back(p);
+		beacons.push_back(polygon.attribute("beacon").as_bool());
+	}
+
+	//Set up robot from xml.
+	pugi::xml_node robot = root.child("robot");
+	robotWidth = robot.attribute("width").as_float();
+	robotHeight = robot.attribute("height").as_float();
+	pugi::xml_node startVertex = robot.child("start").child("vertex");
+	robotStart = Vertex(startVertex.attribute("x").as_float(), startVertex.attribute("y").as_float());
+	moveRate = (float)atof(robot.child_value("moveRate"));
+	turnRate = (float)atof(robot.child_value("turnRate"));
+	lidarRate = (float)atof(robot.child_value("lidarRate"));
+	noise = (float)atof(robot.child_value("noise"));
+
+	//Set up behaviour from xml.
+	pugi::xml_node behaviour = root.child("behaviour");
+	pugi::xml_node grid = behaviour.child("grid");
+	startGran = (float)atof(grid.child_value("startGran"));
+	minGran = (float)atof(grid.child_value("minGran"));
+	split = (float)atof(grid.child_value("split"));
+	gridOptions.stampError = atof(grid.child_value("stampError"));
+	gridOptions.localRefine = grid.child("localRefine");
+	gridOptions.revert = grid.child("revert");
+	if (grid.child("revert").attribute("limit")) gridOptions.journalLimit = grid.child("revert").attribute("limit").as_int();
+	gridOptions.batchSplit = grid.child("batchSplit");
+	gridOptions.sparse = string(grid.child_value("backend")) == "sparse";
+	gridOptions.mapped = string(grid.child_value("backend")) == "mapped";
+	if (grid.child("backend").attribute("resident")) gridOptions.residentTiles = grid.child("backend").attribute("resident").as_int();
+	if (grid.child("cellBits")) gridOptions.cellBits = atoi(grid.child_value("cellBits"));
+	if (string(grid.child_value("fusion")) == "logOdds") gridOptions.fusion = FUSE_LOG_ODDS;
+	gridOptions.distanceField = grid.child("distanceField");
+	gridOptions.fieldThreshold = atof(grid.child_value("distanceField"));
+	if (grid.child("distanceField").attribute("range")) gridOptions.fieldRange = grid.child("distanceField").attribute("range").as_double();
+	gridOptions.summedArea = grid.child("summedArea");
+	gridOptions.pyramid = grid.child("pyramid");
+	gridOptions.retention = grid.child("retention");
+	gridOptions.retentionTolerance = atof(grid.child_value("retention"));
+	if (grid.child("retention").attribute("budget")) gridOptions.recordBudget = grid.child("retention").attribute("budget").as_int();
+	if (grid.child("smoothBudget")) gridOptions.smoothBudget = atoi(grid.child_value("smoothBudget"));
+	gridOptions.repair = grid.child("repair");
+	strategy = atoi(behaviour.child_value("strategy"));
+
+	//Runtime is stored with the display.
+	runtime = (float)atof(root.child("display").child_value("runtime"));
+
+	//Snapshots of the grid are written when headless, if an interval is given.
+	pugi::xml_node snapshots = root.child("display").child("snapshots");
+	snapshotInterval = snapshots.attribute("interval").as_double();
+	snapshotFile = snapshots.child_value();
+	if (snapshotFile.empty()) snapshotFile = "snapshot";
+}
+
+//Builds a new environment, adding the polygons in the order they were read.
+Environment Scenario::environment() const {
+	Environment e(envWidth, envHeight);
+	for (unsigned int i = 0; i < polygons.size(); i++) {
+		if (beacons[i]) e.addBeacon(polygons[i]);
+		else e.addObstacle(polygons[i]);
+	}
+	return e;
+}
+
+#endif
\ No newline at end of file
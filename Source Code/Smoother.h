@@ -0,0 +1,84 @@
+#ifndef SMOOTHER_H
+#define SMOOTHER_H
+
+#include <vector>
+#include <math.h>
+#include "RecordStore.h"
+using namespace std;
+
+/*
+Smooths the records since the previous beacon once a beacon fixes the pose, as the backward pass of an RTS smoother.
+The pass runs back from the beacon record, keeping only its running estimate of the pose and variance, and the pose the record after had before it was fused.
+So each record is fused in constant time as it is reached, and a pass may stop after any record and carry on later.
+Records fused are noted in fused, so that they may be mapped together once their poses are all set.
+*/
+class Smoother {
+public:
+	Smoother() : active(false), next(0), from(0), x(0), y(0), xV(0), yV(0), forwardX(0), forwardY(0) {}
+	void start(RecordStore &data);
+	bool step(RecordStore &data, float mNoise, unsigned int limit);
+	//
+	//Set while a pass has records left to fuse.
+	bool active;
+	//The next record to fuse, and the beacon record the pass began from.
+	unsigned int next, from;
+	//The backward estimate of the pose of the record after next, and the pose that record had before it was fused.
+	float x, y, xV, yV;
+	float forwardX, forwardY;
+	vector<unsigned int> fused;
+};
+
+//Begins a pass back from the last record, which a beacon has fixed.
+void Smoother::start(RecordStore &data) {
+	from = data.size() - 1;
+	next = from - 1;
+	x = data.x(from); y = data.y(from);
+	xV = data.xV(from); yV = data.yV(from);
+	forwardX = x; forwardY = y;
+	active = !(data.xV(next) == 0 || data.yV(next) == 0);
+}
+
+/*
+Fuses up to limit records, or every record left if limit is 0, until a record with 0 variance.
+Returns true once the pass is done.
+*/
+bool Smoother::step(RecordStore &data, float mNoise, unsigned int limit) {
+	for (unsigned int n = 0; active && (limit == 0 || n < limit); n++) {
+		unsigned int i = next;
+
+		//Find the distance travelled.
+		float dx = data.x(i) - forwardX;
+		float dy = data.y(i) - forwardY;
+		float distance = sqrt(dx * dx + dy * dy);
+
+		//Find the reverse expected location.
+		float radians = data.b(i - 1) * (float)PI / 180;
+		x = x - distance * cos(radians);
+		y = y - distance * sin(radians);
+
+		//Find the reverse variances.
+		xV = xV + abs(dx) * mNoise;
+		yV = yV + abs(dy) * mNoise;
+
+		//Mean location, weighted by variance.
+		float oldX = data.x(i), oldY = data.y(i), oldXV = data.xV(i), oldYV = data.yV(i);
+		float fusedX = oldX + (oldXV / (oldXV + xV)) * (x - oldX);
+		float fusedY = oldY + (oldYV / (oldYV + yV)) * (y - oldY);
+
+		//Improved variance.
+		float xVar = oldXV * xV / (oldXV + xV);
+		float yVar = oldYV * yV / (oldYV + yV);
+
+		//Update the record, its vertex is found again as it is read.
+		forwardX = oldX; forwardY = oldY;
+		data.setPose(i, fusedX, fusedY, xVar, yVar);
+		fused.push_back(i);
+
+		//The pass stops at the previous beacon.
+		next--;
+		active = !(data.xV(next) == 0 || data.yV(next) == 0);
+	}
+	return !active;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,172 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "Grid.h"
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace std;
+
+/*
+Snapshots of a grid are written as a stream of frames, after a header of "GSNP" and the version.
+Each frame starts with its kind, the simulated time, the granularity, xFrom, yFrom, width and height.
+Its cells, row by row, follow as runs: the number of cells unchanged since the previous frame, then the number changed and their probabilities.
+Run lengths are varints and probabilities are floats, in the byte order of the machine.
+A keyframe is written first, and whenever the granularity or extent of the grid changes, with its cells changed from an empty grid.
+*/
+const char snapshotMagic[4] = {'G', 'S', 'N', 'P'};
+const unsigned int snapshotVersion = 1;
+enum SnapshotKind {SNAPSHOT_KEY, SNAPSHOT_DELTA};
+
+//A frame as read back, holding every cell of the grid at that time.
+class SnapshotFrame {
+public:
+	SnapshotFrame() : kind(SNAPSHOT_KEY), time(0), gran(0), xFrom(0), yFrom(0), width(0), height(0) {}
+	SnapshotKind kind;
+	double time, gran, xFrom, yFrom;
+	int width, height;
+	vector<float> cells;
+};
+
+//Writes snapshots of a grid to a file, each changed from the one before.
+class SnapshotWriter {
+public:
+	SnapshotWriter() : frames(0) {}
+	bool open(string filename);
+	void write(Grid &grid, double time);
+	void varint(unsigned int v);
+	//
+	ofstream out;
+	SnapshotFrame previous;
+	int frames;
+};
+
+//Reads snapshots back, applying each frame to the frame before.
+class SnapshotReader {
+public:
+	bool open(string filename);
+	bool next(SnapshotFrame &frame);
+	bool varint(unsigned int &v);
+	//
+	ifstream in;
+};
+
+//Opens the file and writes the header, returning false if it cannot be opened.
+bool SnapshotWriter::open(string filename) {
+	out.open(filename.c_str(), ios::out | ios::binary | ios::trunc);
+	if (!out) return false;
+	out.write(snapshotMagic, 4);
+	out.write((const char *)&snapshotVersion, sizeof(snapshotVersion));
+	return true;
+}
+
+//Writes a run length, 7 bits a byte, with the top bit set on every byte but the last.
+void SnapshotWriter::varint(unsigned int v) {
+	while (v >= 0x80) {
+		out.put((char)(v | 0x80));
+		v >>= 7;
+	}
+	out.put((char)v);
+}
+
+//Writes a frame of the grid at the given simulated time.
+void SnapshotWriter::write(Grid &grid, double time) {
+	SnapshotFrame &p = previous;
+	bool key = frames == 0 || grid.curGran != p.gran || grid.xFrom != p.xFrom || grid.yFrom != p.yFrom ||
+		grid.width != p.width || grid.height != p.height;
+	if (key) p.cells.assign(grid.width * grid.height, 0);
+	p.kind = key ? SNAPSHOT_KEY : SNAPSHOT_DELTA;
+	p.time = time;
+	p.gran = grid.curGran; p.xFrom = grid.xFrom; p.yFrom = grid.yFrom;
+	p.width = grid.width; p.height = grid.height;
+
+	unsigned char kind = (unsigned char)p.kind;
+	out.write((const char *)&kind, 1);
+	out.write((const char *)&p.time, sizeof(double));
+	out.write((const char *)&p.gran, sizeof(double));
+	out.write((const char *)&p.xFrom, sizeof(double));
+	out.write((const char *)&p.yFrom, sizeof(double));
+	out.write((const char *)&p.width, sizeof(int));
+	out.write((const char *)&p.height, sizeof(int));
+
+	//Alternate runs of unchanged and changed cells, up to the last changed cell.
+	int n = grid.width * grid.height, i = 0, run = 0;
+	vector<float> changed;
+	while (i < n) {
+		int unchanged = 0;
+		while (i < n && (float)grid.at(i % grid.width, i / grid.width) == p.cells[i]) { i++; unchanged++; }
+		if (i == n) break;
+		changed.clear();
+		for (; i < n; i++) {
+			float v = (float)grid.at(i % grid.width, i / grid.width);
+			if (v == p.cells[i]) break;
+			p.cells[i] = v;
+			changed.push_back(v);
+		}
+		varint(unchanged);
+		varint((unsigned int)changed.size());
+		out.write((const char *)&changed[0], changed.size() * sizeof(float));
+		run += unchanged + (int)changed.size();
+	}
+
+	//The rest of the grid is unchanged, which the reader knows from the size.
+	varint(n - run);
+	varint(0);
+	out.flush();
+	frames++;
+}
+
+//Opens the file and checks the header, returning false if it is not a stream of snapshots.
+bool SnapshotReader::open(string filename) {
+	in.open(filename.c_str(), ios::in | ios::binary);
+	char magic[4];
+	unsigned int version = 0;
+	in.read(magic, 4);
+	in.read((char *)&version, sizeof(version));
+	return in && equal(magic, magic + 4, snapshotMagic) && version == snapshotVersion;
+}
+
+//Reads a run length, returning false at the end of the file.
+bool SnapshotReader::varint(unsigned int &v) {
+	v = 0;
+	for (int shift = 0; ; shift += 7) {
+		int c = in.get();
+		if (c == EOF) return false;
+		v |= (unsigned int)(c & 0x7F) << shift;
+		if (!(c & 0x80)) return true;
+	}
+}
+
+//Reads the next frame over the previous one, returning false at the end of the stream, or if the frame is not one the writer could have written.
+bool SnapshotReader::next(SnapshotFrame &frame) {
+	unsigned char kind;
+	if (!in.read((char *)&kind, 1)) return false;
+	frame.kind = (SnapshotKind)kind;
+	in.read((char *)&frame.time, sizeof(double));
+	in.read((char *)&frame.gran, sizeof(double));
+	in.read((char *)&frame.xFrom, sizeof(double));
+	in.read((char *)&frame.yFrom, sizeof(double));
+	in.read((char *)&frame.width, sizeof(int));
+	in.read((char *)&frame.height, sizeof(int));
+	if (!in || kind > SNAPSHOT_DELTA || frame.width < 0 || frame.height < 0) return false;
+
+	//A delta applies to a frame of the same extent, as a new extent starts a keyframe.
+	int n = frame.width * frame.height, i = 0;
+	if (frame.kind == SNAPSHOT_KEY) frame.cells.assign(n, 0);
+	else if (frame.cells.size() != (size_t)n) return false;
+
+	//Runs end with the run of unchanged cells reaching the end of the grid.
+	while (true) {
+		unsigned int unchanged, changed;
+		if (!varint(unchanged) || !varint(changed)) return false;
+		i += unchanged;
+		if (changed == 0 && i >= n) return true;
+		if (i + (int)changed > n) return false;
+		in.read((char *)&frame.cells[i], changed * sizeof(float));
+		if (!in) return false;
+		i += changed;
+	}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,88 @@
+#ifndef STAMP_H
+#define STAMP_H
+
+#include <vector>
+#include <unordered_map>
+#include <math.h>
+#include <boost/math/distributions/normal.hpp>
+using namespace std;
+
+/*
+The probabilities of a run of cells along one axis, for a point in the cell at 0.
+first: the cell of the first probability, relative to the cell of the point.
+*/
+class Stamp {
+public:
+	int first;
+	vector<double> p;
+};
+
+/*
+Caches stamps by the standard deviation and the offset of a point within its cell, both measured in cells.
+These are quantized finely enough that any probability read from a stamp is within error / 2 of its exact value.
+Taking a stamp per axis, a cell probability is then within the error of its exact value.
+*/
+class StampCache {
+public:
+	StampCache(double error = 0);
+	const Stamp *find(double sd, double offset);
+	//
+	double error;
+	double sdStep;
+	unordered_map<unsigned long long, Stamp> stamps;
+	//Stamps are all dropped once there are this many.
+	//Points so narrow that they need more offsets than this are mapped exactly.
+	static const int maxStamps = 65536;
+	static const int maxOffsets = 4096;
+};
+
+StampCache::StampCache(double error) {
+	this->error = error;
+
+	//Half of the error of an axis comes from each quantization, see find().
+	sdStep = (error > 0) ? 2 * (error / 4) / 0.484 : 0;
+}
+
+/*
+Finds the stamp for a point with the given deviation and offset (0 <= offset < 1), or NULL if it is not worth caching.
+Per unit of log deviation a cell probability changes by at most 2 * max(t * pdf(t)) = 0.484.
+Per cell of offset it changes by at most pdf(0) / sd = 0.399 / sd.
+*/
+const Stamp *StampCache::find(double sd, double offset) {
+	if (error <= 0 || sd <= 0) return NULL;
+
+	//Quantize the deviation on a log scale, rounding to the nearest step.
+	int sdBin = (int)floor(log(sd) / sdStep + 0.5);
+
+	//Quantize the offset, more finely for narrow points.
+	double sdLow = exp((sdBin - 0.5) * sdStep);
+	int offsets = (int)ceil(0.399 / sdLow / (2 * (error / 4)));
+	if (offsets < 1) offsets = 1;
+	if (offsets > maxOffsets) return NULL;
+	int offsetBin = (int)(offset * offsets);
+	if (offsetBin >= offsets) offsetBin = offsets - 1;
+
+	unsigned long long key = ((unsigned long long)(unsigned int)sdBin << 32) | (unsigned int)offsetBin;
+	unordered_map<unsigned long long, Stamp>::iterator i = stamps.find(key);
+	if (i != stamps.end()) return &i->second;
+	if ((int)stamps.size() >= maxStamps) stamps.clear();
+
+	//Calculate the stamp at the centre of the bins.
+	//It covers every cell within 3sd of any point in the bins, with a cell to spare either side.
+	double s = exp(sdBin * sdStep);
+	double f = (offsetBin + 0.5) / offsets;
+	double reach = 3 * exp((sdBin + 0.5) * sdStep);
+	Stamp &stamp = stamps[key];
+	stamp.first = (int)floor(-reach) - 1;
+	int last = (int)ceil(1 + reach) + 1;
+	boost::math::normal_distribution<double> normal(0, 1);
+	double lower = cdf(normal, (stamp.first - f) / s);
+	for (int k = stamp.first; k <= last; k++) {
+		double upper = cdf(normal, (k + 1 - f) / s);
+		stamp.p.push_back(upper - lower);
+		lower = upper;
+	}
+	return &stamp;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef SUMMEDAREA_H
+#define SUMMEDAREA_H
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "Tiles.h"
+using namespace std;
+
+/*
+The summed-area table of a square of cells, with a row and column of zeros before its cells.
+sums[(y + 1) * (tileCells + 1) + x + 1] is the sum of the cells from 0, 0 to x, y of the tile.
+dirtyFrom: the first row of the tile with a cell changed since the sums were found, the sums of the rows before stand.
+*/
+class SumTile {
+public:
+	SumTile() : dirtyFrom(0) {}
+	vector<long long> sums;
+	int dirtyFrom;
+};
+
+/*
+Sums of cell probabilities over rectangles of the grid, in a few lookups per tile the rectangle covers.
+Each tile of cells keeps its own summed-area table, so a changed cell only dirties the table of its tile.
+Tables are found as they are read, and found again from the first row dirtied since.
+Probabilities are summed in fixed point, in units of 2^-32, so that sums are exact and a sum is 0 only if every cell is.
+A probability too small to be a float counts as 0, and any other as at least one unit.
+Tiles are kept by their coords from the world origin, like the tiles of a sparse grid, so they stay put as the grid grows.
+*/
+class SummedArea {
+public:
+	static const int tileCells = Tiles::tileCells;
+	SummedArea() : enabled(false), stale(false), gran(0), xFrom(0), yFrom(0), width(0), height(0) {}
+	static long long units(double p) {
+		if ((float)p == 0) return 0;
+		long long u = (long long)(p * 4294967296.0);
+		return (u < 1) ? 1 : u;
+	}
+	static double probability(long long units) { return units / 4294967296.0; }
+	void touch(int xMin, int yMin, int xMax, int yMax);
+	void dirtyAll();
+	//
+	bool enabled;
+	//Set when every table must be dropped before the next sum, as cells have fallen or moved.
+	bool stale;
+	//The granularity and extent, in cells from the world origin, of the grid when the tables were last read.
+	double gran;
+	int xFrom, yFrom, width, height;
+	unordered_map<unsigned long long, SumTile> tiles;
+};
+
+//Dirties the tables of the tiles covering the given cells, by their coords from the world origin.
+void SummedArea::touch(int xMin, int yMin, int xMax, int yMax) {
+	for (int ty = Tiles::tile(yMin); ty <= Tiles::tile(yMax); ty++)
+		for (int tx = Tiles::tile(xMin); tx <= Tiles::tile(xMax); tx++) {
+			unordered_map<unsigned long long, SumTile>::iterator i = tiles.find(Tiles::key(tx, ty));
+			if (i == tiles.end()) continue;
+			int row = max(yMin - ty * tileCells, 0);
+			if (row < i->second.dirtyFrom) i->second.dirtyFrom = row;
+		}
+}
+
+//Dirties every table.
+void SummedArea::dirtyAll() {
+	for (unordered_map<unsigned long long, SumTile>::iterator i = tiles.begin(); i != tiles.end(); i++)
+		i->second.dirtyFrom = 0;
+}
+
+#endif
\ No newline at end of file
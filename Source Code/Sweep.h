@@ -0,0 +1,144 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "Scenario.h"
+#include "Headless.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//A setting of the scenario and the values it is swept over.
+class Axis {
+public:
+	Axis(string name, vector<double> values) : name(name), values(values) {}
+	string name;
+	vector<double> values;
+};
+
+/*
+Reads the values of a swept setting.
+Either a list of values '1 2 4', or a range from = '0.2' to = '0.8' step = '0.2'.
+*/
+vector<double> sweepValues(pugi::xml_node node) {
+	vector<double> values;
+	if (node.attribute("step")) {
+		double from = node.attribute("from").as_double();
+		double to = node.attribute("to").as_double();
+		double step = node.attribute("step").as_double();
+		if (step <= 0) return values;
+		//Count the steps rather than accumulating them, so the last value is not lost to rounding.
+		int n = (int)floor((to - from) / step + 0.000001);
+		for (int i = 0; i <= n; i++)
+			values.push_back(from + i * step);
+	}
+	else {
+		stringstream ss(node.child_value());
+		double value;
+		while (ss >> value) values.push_back(value);
+	}
+	return values;
+}
+
+//Sets the named setting of a scenario, returns false if it cannot be swept.
+bool sweepSet(Scenario &s, string name, double value) {
+	if (name == "startGran") s.startGran = (float)value;
+	else if (name == "minGran") s.minGran = (float)value;
+	else if (name == "split") s.split = (float)value;
+	else if (name == "strategy") s.strategy = (int)value;
+	else if (name == "noise") s.noise = (float)value;
+	else if (name == "moveRate") s.moveRate = (float)value;
+	else if (name == "lidarRate") s.lidarRate = (float)value;
+	else return false;
+	return true;
+}
+
+//Gets the named setting of a scenario.
+double sweepGet(const Scenario &s, string name) {
+	if (name == "startGran") return s.startGran;
+	if (name == "minGran") return s.minGran;
+	if (name == "split") return s.split;
+	if (name == "strategy") return s.strategy;
+	if (name == "noise") return s.noise;
+	if (name == "moveRate") return s.moveRate;
+	return s.lidarRate;
+}
+
+//Expands the cartesian product of the axes into a scenario per point.
+vector<Scenario> sweepPoints(const Scenario &base, vector<Axis> &axes) {
+	vector<Scenario> points;
+	vector<unsigned int> index(axes.size(), 0);
+	for (unsigned int i = 0; i < axes.size(); i++)
+		if (axes[i].values.empty()) return points;
+
+	while (true) {
+		Scenario s = base;
+		for (unsigned int i = 0; i < axes.size(); i++)
+			sweepSet(s, axes[i].name, axes[i].values[index[i]]);
+		//Every point would snapshot to the same files, so none do.
+		s.snapshotInterval = 0;
+
+		//The grid cannot divide below a minimum larger than the start.
+		if (s.minGran <= s.startGran) points.push_back(s);
+
+		//Advance the last axis, carrying into the previous ones.
+		int i = (int)axes.size() - 1;
+		for (; i >= 0; i--) {
+			if (++index[i] < axes[i].values.size()) break;
+			index[i] = 0;
+		}
+		if (i < 0) return points;
+	}
+}
+
+/*
+Runs every test of every point of a sweep across a number of threads.
+The sweep node names the settings to sweep over the base scenario, e.g.
+<sweep><startGran>1 2 4</startGran><noise from = '0' to = '0.02' step = '0.01'/></sweep>
+All results are written to 'sweep.txt' as a single table, with a row per test.
+*/
+void sweep(const Scenario &base, pugi::xml_node node, unsigned int seed, int threads) {
+	//A runtime is needed for a test to end.
+	if (base.runtime <= 0) {
+		cout << "Headless mode requires a runtime." << endl;
+		return;
+	}
+
+	//Read the axes.
+	vector<Axis> axes;
+	for (pugi::xml_node child = node.first_child(); child; child = child.next_sibling()) {
+		Scenario s;
+		if (!sweepSet(s, child.name(), 0)) {
+			cout << "Cannot sweep '" << child.name() << "'." << endl;
+			return;
+		}
+		axes.push_back(Axis(child.name(), sweepValues(child)));
+	}
+
+	//Expand the points and schedule every test of every point.
+	vector<Scenario> points = sweepPoints(base, axes);
+	vector<Job> jobs;
+	for (unsigned int p = 0; p < points.size(); p++)
+		for (int test = 0; test < points[p].tests; test++)
+			jobs.push_back(Job(&points[p], test));
+	cout << points.size() << " points, " << jobs.size() << " tests." << endl;
+	runJobs(jobs, seed, threads);
+
+	//Write the table, with every setting that may be swept.
+	const char *names[] = {"startGran", "minGran", "split", "strategy", "noise", "moveRate", "lidarRate"};
+	ofstream out("sweep.txt");
+	for (int i = 0; i < 7; i++)
+		out << names[i] << "\t";
+	out << "test\texit\tcompleteness\taccuracy" << endl;
+	for (unsigned int i = 0; i < jobs.size(); i++) {
+		for (int j = 0; j < 7; j++)
+			out << sweepGet(*jobs[i].s, names[j]) << "\t";
+		out << jobs[i].test + 1;
+		out << "\t" << jobs[i].result.exit;
+		out << "\t" << jobs[i].result.completeness;
+		out << "\t" << jobs[i].result.accuracy << endl;
+	}
+	out.close();
+}
+
+#endif
\ No newline at end of file
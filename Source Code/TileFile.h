@@ -0,0 +1,152 @@
+#ifndef TILEFILE_H
+#define TILEFILE_H
+
+#include <vector>
+#include <cstdio>
+#include <new>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+/*
+Tiles of cells kept in slots of a temporary file, which is deleted once closed.
+Only the most recently used tiles are mapped into memory, the rest are left to the file.
+Each slot is rounded up to the granularity a view of the file may start at.
+*/
+class TileFile {
+public:
+	TileFile(size_t tileBytes, int maxResident);
+	~TileFile();
+	int add();
+	double *cells(int slot);
+	void clear();
+	void resize(int newCapacity);
+	void unmap(int slot);
+	void unmapAll();
+	//
+	FILE *file;
+	size_t tileBytes, slotBytes;
+	int slots, capacity, maxResident;
+	//The view of each slot, or NULL if it is paged out, and when it was last used.
+	vector<double *> views;
+	vector<unsigned long long> used;
+	vector<int> resident;
+	unsigned long long clock;
+#ifdef _WIN32
+	HANDLE mapping;
+#endif
+};
+
+TileFile::TileFile(size_t tileBytes, int maxResident) {
+	this->tileBytes = tileBytes;
+	this->maxResident = (maxResident > 0) ? maxResident : 1;
+	slots = 0; capacity = 0;
+	clock = 0;
+	file = tmpfile();
+	if (!file) throw bad_alloc();
+#ifdef _WIN32
+	mapping = NULL;
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	size_t granularity = info.dwAllocationGranularity;
+#else
+	size_t granularity = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	slotBytes = (tileBytes + granularity - 1) / granularity * granularity;
+}
+
+TileFile::~TileFile() {
+	unmapAll();
+#ifdef _WIN32
+	if (mapping) CloseHandle(mapping);
+#endif
+	fclose(file);
+}
+
+//Adds a slot of empty cells, growing the file to twice the slots needed if it is full.
+int TileFile::add() {
+	if (slots == capacity) resize((capacity > 0) ? capacity * 2 : 64);
+	return slots++;
+}
+
+//Sizes the file to hold the given number of slots, any cells added are empty.
+void TileFile::resize(int newCapacity) {
+	long long bytes = (long long)newCapacity * slotBytes;
+#ifdef _WIN32
+	//A file cannot be resized while it is mapped.
+	unmapAll();
+	if (mapping) CloseHandle(mapping);
+	mapping = NULL;
+	if (_chsize_s(_fileno(file), bytes) != 0) throw bad_alloc();
+	if (bytes > 0) {
+		mapping = CreateFileMapping((HANDLE)_get_osfhandle(_fileno(file)), NULL, PAGE_READWRITE, 0, 0, NULL);
+		if (!mapping) throw bad_alloc();
+	}
+#else
+	if (ftruncate(fileno(file), (off_t)bytes) != 0) throw bad_alloc();
+#endif
+	capacity = newCapacity;
+	views.resize(capacity, NULL);
+	used.resize(capacity, 0);
+}
+
+//Finds the cells of a slot, mapping the slot in place of the least recently used if it is paged out.
+double *TileFile::cells(int slot) {
+	used[slot] = ++clock;
+	if (views[slot]) return views[slot];
+
+	if ((int)resident.size() >= maxResident) {
+		int oldest = 0;
+		for (unsigned int i = 1; i < resident.size(); i++)
+			if (used[resident[i]] < used[resident[oldest]]) oldest = i;
+		unmap(resident[oldest]);
+		resident[oldest] = resident.back();
+		resident.pop_back();
+	}
+
+	long long offset = (long long)slot * slotBytes;
+#ifdef _WIN32
+	void *view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, (DWORD)(offset >> 32), (DWORD)offset, tileBytes);
+	if (!view) throw bad_alloc();
+#else
+	void *view = mmap(NULL, tileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file), (off_t)offset);
+	if (view == MAP_FAILED) throw bad_alloc();
+#endif
+	views[slot] = (double *)view;
+	resident.push_back(slot);
+	return views[slot];
+}
+
+//Pages out a slot, its cells are kept in the file.
+void TileFile::unmap(int slot) {
+	if (!views[slot]) return;
+#ifdef _WIN32
+	UnmapViewOfFile(views[slot]);
+#else
+	munmap(views[slot], tileBytes);
+#endif
+	views[slot] = NULL;
+}
+
+//Pages out every slot.
+void TileFile::unmapAll() {
+	for (unsigned int i = 0; i < resident.size(); i++) unmap(resident[i]);
+	resident.clear();
+}
+
+//Drops every slot, truncating the file so that it holds only empty cells when used again.
+void TileFile::clear() {
+	unmapAll();
+	int oldCapacity = capacity;
+	resize(0);
+	resize(oldCapacity);
+	slots = 0;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include "TileFile.h"
+using namespace std;
+
+/*
+A square of cells, stored row by row.
+x, y: the cell coords of its first cell.
+slot: where the cells are kept when the tiles are mapped from a file, rather than held in memory.
+*/
+class Tile {
+public:
+	Tile() : x(0), y(0), slot(-1) {}
+	int x, y;
+	vector<double> cells;
+	int slot;
+};
+
+/*
+Cells stored sparsely in tiles, kept by tile coords and only allocated once a cell of the tile is mapped.
+Cells are addressed by their coords from the world origin, so the tiles never move as the grid grows.
+The tiles may be kept in a file instead, with only those most recently used in memory.
+A copy is then given a file of its own, with the cells of every tile copied into it.
+*/
+class Tiles {
+public:
+	static const int tileCells = 32;
+	Tiles() {}
+	Tiles(const Tiles &other) { *this = other; }
+	Tiles &operator=(const Tiles &other);
+	void map(int maxResident);
+	double at(int x, int y);
+	double *run(int x, int y, int &n);
+	double *cells(Tile &t) { return file ? file->cells(t.slot) : &t.cells[0]; }
+	Tile &find(int tx, int ty);
+	void touch(int xMin, int yMin, int xMax, int yMax);
+	void clear();
+	static int tile(int c) { return (c >= 0 ? c : c - (tileCells - 1)) / tileCells; }
+	static unsigned long long key(int tx, int ty) { return ((unsigned long long)(unsigned int)tx << 32) | (unsigned int)ty; }
+	//
+	unordered_map<unsigned long long, Tile> tiles;
+	shared_ptr<TileFile> file;
+};
+
+//Keeps the tiles in a temporary file, with at most maxResident of them in memory.
+void Tiles::map(int maxResident) {
+	tiles.clear();
+	file = make_shared<TileFile>(tileCells * tileCells * sizeof(double), maxResident);
+}
+
+//Copies the tiles of another, into a file of their own if they are kept in a file.
+Tiles &Tiles::operator=(const Tiles &other) {
+	if (this == &other) return *this;
+	tiles = other.tiles;
+	file.reset();
+	if (!other.file) return *this;
+	file = make_shared<TileFile>(other.file->tileBytes, other.file->maxResident);
+	for (unordered_map<unsigned long long, Tile>::iterator i = tiles.begin(); i != tiles.end(); i++) {
+		int slot = i->second.slot;
+		i->second.slot = file->add();
+		const double *from = other.file->cells(slot);
+		copy(from, from + tileCells * tileCells, file->cells(i->second.slot));
+	}
+	return *this;
+}
+
+//The probability of a cell, 0 if its tile has not been allocated.
+double Tiles::at(int x, int y) {
+	int tx = tile(x), ty = tile(y);
+	unordered_map<unsigned long long, Tile>::iterator i = tiles.find(key(tx, ty));
+	if (i == tiles.end()) return 0;
+	return cells(i->second)[(y - ty * tileCells) * tileCells + x - tx * tileCells];
+}
+
+//Finds a tile by its tile coords, allocating it if need be.
+//Tiles which exist are only looked up, so that threads may find them at once.
+Tile &Tiles::find(int tx, int ty) {
+	unordered_map<unsigned long long, Tile>::iterator i = tiles.find(key(tx, ty));
+	if (i != tiles.end()) return i->second;
+	Tile &t = tiles[key(tx, ty)];
+	t.x = tx * tileCells; t.y = ty * tileCells;
+	if (file) t.slot = file->add();
+	else t.cells.assign(tileCells * tileCells, 0);
+	return t;
+}
+
+/*
+Finds a cell, allocating its tile if need be, and the number of cells n from it to the end of the tile row.
+Pointers to cells stay valid as other tiles are allocated, but not once a tile is paged in from the file.
+*/
+double *Tiles::run(int x, int y, int &n) {
+	Tile &t = find(tile(x), tile(y));
+	n = t.x + tileCells - x;
+	return cells(t) + (y - t.y) * tileCells + x - t.x;
+}
+
+//Allocates every tile of the cells from xMin, yMin to xMax, yMax.
+void Tiles::touch(int xMin, int yMin, int xMax, int yMax) {
+	for (int ty = tile(yMin); ty <= tile(yMax); ty++)
+		for (int tx = tile(xMin); tx <= tile(xMax); tx++)
+			find(tx, ty);
+}
+
+//Drops every tile.
+void Tiles::clear() {
+	tiles.clear();
+	if (file) file->clear();
+}
+
+#endif
\ No newline at end of file
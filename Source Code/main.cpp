@@ -3,13 +3,45 @@
 #include "Environment.h"
 #include "Robot.h"
 #include "Behaviour.h"
+#include "Scenario.h"
+#include "Headless.h"
+#include "Sweep.h"
+#include "Benchmark.h"
+//Define HEADLESS to build without GLUT.
+#ifndef HEADLESS
 #include "Display.h"
+#endif
 #include "xml/pugixml.cpp"
 using namespace pugi;
 #include <iostream>
 using namespace std;
 
 int main(int argc, char **argv) {
+	//Time the grid instead of running a simulation.
+	if (argc > 1 && string(argv[1]) == "-benchmark") {
+		benchmark();
+		return 0;
+	}
+
+	//Summarise each frame of a snapshot file instead of running a simulation.
+	if (argc > 2 && string(argv[1]) == "-inspect") {
+		SnapshotReader reader;
+		if (!reader.open(argv[2])) {
+			cout << "Snapshot file cannot be read." << endl;
+			return 0;
+		}
+		SnapshotFrame frame;
+		cout << "Time\tKind\tGran\tWidth\tHeight\tMapped" << endl;
+		while (reader.next(frame)) {
+			int mapped = 0;
+			for (unsigned int i = 0; i < frame.cells.size(); i++)
+				if (frame.cells[i] > 0) mapped++;
+			cout << frame.time << "\t" << (frame.kind == SNAPSHOT_KEY ? "key" : "delta") << "\t" << frame.gran;
+			cout << "\t" << frame.width << "\t" << frame.height << "\t" << mapped << endl;
+		}
+		return 0;
+	}
+
 	//If no file specified, assume 'e1s1.xml'.
 	if (argc <= 1)
 		argv[1] = "e1s1.xml";
@@ -27,41 +59,51 @@ int main(int argc, char **argv) {
 		return 0;
 	}
 
-	//Get the number of tests from xml.
-	int tests = atoi(xml.child("root").child_value("tests"));
+	//Read the settings from xml.
+	Scenario s(xml.child("root"));
+	unsigned int seed = s.seeded ? s.seed : (unsigned int)time(NULL);
+	cout << "Seed " << seed << endl;
+
+	//Read the optional arguments after the file.
+	//-headless: run without a window, builds without GLUT always do.
+	//-threads n: number of tests to run at once when headless, defaults to all cores.
+	//-sweep file: run the tests headless over the settings swept in file.
+	bool headlessRun = false;
+	int threads = thread::hardware_concurrency();
+	char *sweepFile = NULL;
+	for (int i = 2; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "-headless") headlessRun = true;
+		else if (arg == "-threads" && i + 1 < argc) threads = atoi(argv[++i]);
+		else if (arg == "-sweep" && i + 1 < argc) sweepFile = argv[++i];
+	}
+	if (threads < 1) threads = 1;
 
-	//Set up environment from xml.
-	xml_node env = xml.child("root").child("environment");
-	Environment e(env.attribute("width").as_float(), env.attribute("height").as_float());
-	for (xml_node polygon = env.child("polygon"); polygon; polygon = polygon.next_sibling("polygon")) {
-		Polygon p;
-		for (xml_node vertex = polygon.child("vertex"); vertex; vertex = vertex.next_sibling("vertex")) {
-			p.addVertex(Vertex(vertex.attribute("x").as_float(), vertex.attribute("y").as_float()));
+	if (sweepFile) {
+		xml_document sweepXml;
+		if (!sweepXml.load_file(sweepFile)) {
+			cout << "Sweep file cannot be found." << endl;
+			return 0;
 		}
-		if (polygon.attribute("beacon").as_bool()) e.addBeacon(p);
-		else e.addObstacle(p);
+		sweep(s, sweepXml.child("sweep"), seed, threads);
+		return 0;
 	}
 
-	//Set up robot from xml.
-	xml_node robot = xml.child("root").child("robot");
-	float robotWidth = robot.attribute("width").as_float();
-	float robotHeight = robot.attribute("height").as_float();
-	xml_node startVertex = robot.child("start").child("vertex");
-	Vertex robotStart(startVertex.attribute("x").as_float(), startVertex.attribute("y").as_float());
-	float moveRate = atof(robot.child_value("moveRate"));
-	float turnRate = atof(robot.child_value("turnRate"));
-	float lidarRate = atof(robot.child_value("lidarRate"));
-	float noise = atof(robot.child_value("noise"));
-	Robot r(robotWidth, robotHeight, robotStart, moveRate, turnRate, lidarRate, noise, 0, 0, &e);
+#ifdef HEADLESS
+	headlessRun = true;
+#endif
+	if (headlessRun) {
+		headless(s, argv[1], seed, threads);
+		return 0;
+	}
 
-	//Set up behaviour from xml.
-	xml_node behaviour = xml.child("root").child("behaviour");
-	xml_node grid = behaviour.child("grid");
-	float startGran = atof(grid.child_value("startGran"));
-	float minGran = atof(grid.child_value("minGran"));
-	float split = atof(grid.child_value("split"));
-	int strategy = atoi(behaviour.child_value("strategy"));
-	Behaviour b(&r, startGran, minGran, split, strategy);
+#ifndef HEADLESS
+	//Set up the environment, robot and behaviour for display.
+	//With a single test, the grid is rebuilt across the threads instead.
+	s.gridOptions.threads = threads;
+	Environment e = s.environment();
+	Robot r(s.robotWidth, s.robotHeight, s.robotStart, s.moveRate, s.turnRate, s.lidarRate, s.noise, 0, 0, &e, Random(seed));
+	Behaviour b(&r, s.startGran, s.minGran, s.split, s.strategy, s.gridOptions);
 
 	//Set up display from xml.
 	xml_node displayN = xml.child("root").child("display");
@@ -92,10 +134,10 @@ int main(int argc, char **argv) {
 	bool quadV = defaultN.child("quadrantsV");
 	bool seekV = defaultN.child("seekV");
 	bool debugV = defaultN.child("debugV");
-	float runtime = atof(displayN.child_value("runtime"));
 	display(argc, argv, &e, &r, &b, displayWidth, displayHeight, robotV, lidarV, obstaclesV, beaconsV, overlayV,
 			collisionV, detectorV, ellipsesV, pathV, gridV, mappingsV, verticesV, trackerV,
-			quadV, seekV, debugV, runtime, tests);
+			quadV, seekV, debugV, s.runtime, s.tests);
+#endif
 
 	return 0;
 }
\ No newline at end of file